@@ -28,6 +28,7 @@ typedef struct _configuration {
     char once;
     char* iter_buf; // used for strtok_r()
     char* sav_buf;  // used for strtok_r()
+    ptr_list_iter_t list_iter; // where iterate_config() is in a list
 } configuration_t;
 
 #define BEGIN_CONFIG configuration_t _global_config[] = { \
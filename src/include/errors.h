@@ -11,8 +11,10 @@ void command_error(const char* str, ...);
 
 int get_num_errors();
 int get_num_warnings();
+int get_thread_num_msgs();
 void inc_error_count();
 void inc_warning_count();
 FILE* get_err_stream();
+void set_thread_err_stream(FILE* fp);
 
 #endif
\ No newline at end of file
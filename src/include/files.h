@@ -2,6 +2,7 @@
 #define __FILES_H__
 
 int file_exists(char* fname);
+char* find_input_file(const char* base);
 void open_input_file(const char* base);
 
 #endif
@@ -13,6 +13,7 @@
  */
 
 #include <stdlib.h>
+#include <stdint.h>
 
 typedef enum {
     HASH_NO_ERROR,
@@ -24,21 +25,48 @@ typedef enum {
 
 typedef struct {
     const char* key;
+    uint32_t hash;
     size_t size;
     void* data;
 } _table_entry_t;
 
 typedef struct {
     size_t count;
+    size_t deleted;
     size_t capacity;
+    int8_t* ctrl;
     _table_entry_t* entries;
+    // values of a table made by create_hash_table_sized()
+    size_t value_size;
+    char** slabs;
+    size_t slab_count;
+    size_t slab_used;
+    void* free_values;
 } hashtable_t;
 
+// where a walk of a table is, see init_hash_iter()
+typedef struct {
+    hashtable_t* tab;
+    size_t index;
+} hash_iter_t;
+
 hashtable_t* create_hash_table(void);
+hashtable_t* create_hash_table_sized(size_t);
 void destroy_hash_table(hashtable_t*);
+uint32_t hash_key(const char*);
+uint32_t hash_key_mem(const char*, size_t);
 hash_retv_t insert_hash(hashtable_t*, const char*, void*, size_t);
+hash_retv_t insert_hash_h(hashtable_t*, const char*, uint32_t, void*, size_t);
 hash_retv_t find_hash(hashtable_t*, const char*, void*, size_t);
+hash_retv_t find_hash_h(hashtable_t*, const char*, uint32_t, void*, size_t);
+void* find_hash_ref(hashtable_t*, const char*);
+void* find_hash_ref_h(hashtable_t*, const char*, uint32_t);
+hash_retv_t remove_hash(hashtable_t*, const char*);
+hash_retv_t remove_hash_h(hashtable_t*, const char*, uint32_t);
 hash_retv_t replace_hash_data(hashtable_t*, const char*, void*, size_t);
 const char* iterate_hash_table(hashtable_t*, int);
+void init_hash_iter(hash_iter_t*, hashtable_t*);
+const char* next_hash_iter(hash_iter_t*);
+void* get_hash_iter_data(hash_iter_t*);
 
 #endif
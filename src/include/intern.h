@@ -0,0 +1,22 @@
+#ifndef __INTERN_H__
+#define __INTERN_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+    Every distinct string that is interned gets a 32 bit id that stays the same
+    for the whole run, in every thread. Two strings are the same if their ids
+    are the same. The id 0 is never given out, so it can mean "no string".
+*/
+#define NO_INTERN_ID    (0)
+
+void init_intern();
+uint32_t intern_mem(const char* str, size_t len);
+uint32_t intern_str(const char* str);
+const char* get_intern_str(uint32_t id);
+size_t get_intern_len(uint32_t id);
+uint32_t get_intern_hash(uint32_t id);
+uint32_t get_intern_count();
+
+#endif
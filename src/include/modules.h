@@ -0,0 +1,20 @@
+#ifndef __MODULES_H__
+#define __MODULES_H__
+
+#include <stdint.h>
+
+/*
+    A module is a file that has been imported. It is only scanned and loaded
+    the first time it's imported. After that, importing it again just binds a
+    new name to the symbol that it was loaded into.
+*/
+typedef struct {
+    char* path;     // canonical path of the file
+    uint64_t hash;  // hash of the contents of the file
+    struct _symbol_t* sym; // the symbols that were loaded from the module
+} module_t;
+
+void init_modules();
+module_t* load_module(const char* fname, int* is_new);
+
+#endif
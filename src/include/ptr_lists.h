@@ -14,6 +14,15 @@ typedef struct
     void** buffer;      // raw buffer where the items are kept
 } ptr_list_t;
 
+/**
+ * @brief Where a walk of a list is, see init_ptr_list_iter().
+ */
+typedef struct
+{
+    ptr_list_t* list;
+    size_t index;
+} ptr_list_iter_t;
+
 void init_ptr_list(ptr_list_t* list);
 ptr_list_t* create_ptr_list(void);
 void destroy_ptr_list(ptr_list_t* array);
@@ -21,5 +30,7 @@ void append_ptr_list(ptr_list_t* array, void* item);
 void* get_ptr_list_by_index(ptr_list_t* array, int index);
 void* get_ptr_list_next(ptr_list_t* lst);
 void reset_ptr_list(ptr_list_t* lst);
+void init_ptr_list_iter(ptr_list_iter_t* iter, ptr_list_t* list);
+void* next_ptr_list_iter(ptr_list_iter_t* iter);
 
 #endif
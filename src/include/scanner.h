@@ -82,6 +82,9 @@ typedef enum {
     NAMESPACE_TOKEN,
 } token_t;
 
+// the last token in the list above
+#define LAST_TOKEN  NAMESPACE_TOKEN
+
 #define TOK_TO_STR(t) \
     (((t)==ERROR_TOKEN)? "ERROR": \
     ((t)==END_OF_INPUT)? "END OF INPUT": \
@@ -160,20 +163,134 @@ typedef enum {
     ((t)==INLINE_TOKEN)? "'inline'": "UNKNOWN")
 
 #include <stdint.h>
+#include <stddef.h>
 
 #define MAX_FILE_NESTING    (15)
 
+/*
+    The text of a token is a slice of the source it was read from. Tokens whose
+    text is not the same as the source, such as strings with escapes in them,
+    are copied into a side buffer and have a file_id of SLICE_SIDE_BUFFER.
+    Slices stay valid until the scanner is destroyed.
+*/
+#define SLICE_SIDE_BUFFER   (-1)
+
+typedef struct {
+    int file_id;
+    size_t offset;
+    size_t length;
+} tok_slice_t;
+
+/*
+    The value of a number token. INUM_TOKEN has the int_val, UNUM_TOKEN and
+    ONUM_TOKEN have the uint_val and FNUM_TOKEN has the float_val. It's zero
+    for every other token.
+*/
+typedef union {
+    uint64_t uint_val;
+    int64_t int_val;
+    double float_val;
+} tok_value_t;
+
+/*
+    Everything that is known about a token that has been scanned. The start
+    and end are offsets in the file the token was read from. The end is where
+    the scanner stopped, which is what get_line_no() and get_column_no()
+    report.
+*/
+typedef struct {
+    token_t tok;
+    tok_slice_t slice;
+    uint32_t id;    // interned id of a symbol, NO_INTERN_ID for other tokens
+    tok_value_t value;
+    int file_id;    // file the token was read from, or -1 at the end of input
+    size_t start;
+    size_t end;
+} token_info_t;
+
+/*
+    A block of tokens kept as parallel arrays, for passes that work over many
+    tokens at once. The start and length are where the token is in the file it
+    was read from, including the quotes of a string. Strings with escapes in
+    them have their text in the side buffer at the side offset, with the side
+    length, since the text can have a NUL in it. Tokens whose text is in the
+    file have a side offset of BLOCK_NO_SIDE. Use get_block_slice() to get the
+    text of a token.
+
+    A block that relex_tokens() has changed can have a gap in its arrays and
+    starts that have not been moved yet. get_block_slice() and the scanner read
+    around the gap. Call settle_block() before reading the arrays of such a
+    block directly.
+*/
+#define BLOCK_NO_SIDE       (UINT32_MAX)
+
+typedef struct {
+    int count;
+    int capacity;
+    token_t* tok;
+    int* file_id;
+    uint32_t* start;
+    uint32_t* length;
+    uint32_t* side;
+    uint32_t* side_length;
+    uint32_t* id;       // interned id of each symbol, see intern.h
+    tok_value_t* value;
+    char* side_text;    // a copy of the side buffer, see keep_block_text()
+    size_t side_len;
+    size_t side_dead;   // bytes of side text that no token uses any more
+    void* map;          // the token cache file the arrays are in, or NULL
+    size_t map_len;
+    int gap_pos;        // where the last edit left a gap in the arrays
+    int gap_len;
+    uint32_t shift;     // to add to the starts of the tokens after the gap
+} token_block_t;
+
+// Tokens are scanned ahead into a ring so the parser can look ahead and push
+// tokens back. The ring size must be a power of 2.
+#define TOKEN_RING_SIZE     (64)
+#define MAX_LOOKAHEAD       (TOKEN_RING_SIZE / 2)
+#define TOKEN_BATCH         (16)
+
+/*
+    A scanner holds the open files and the tokens that have been read. The
+    scanner functions use the one that is bound to the calling thread, so a
+    thread has to bind one before it scans anything. init_scanner() creates
+    one for the main thread.
+*/
+typedef struct __scanner scanner_t;
+
 // interface prototypes
 const char* token_to_str(token_t);
 void init_scanner();
+scanner_t* create_scanner();
+void destroy_scanner(scanner_t*);
+scanner_t* bind_scanner(scanner_t*);
+scanner_t* get_scanner();
 token_t get_tok();
+token_t peek_tok(int);
+const token_info_t* peek_tok_info(int);
+void unget_tok();
+token_block_t* create_token_block(int);
+void destroy_token_block(token_block_t*);
+void reset_token_block(token_block_t*);
+int scan_tokens(token_block_t*, int);
+tok_slice_t get_block_slice(token_block_t*, int);
+void keep_block_text(token_block_t*);
+void add_scanned_file(const char*, token_block_t*);
+int relex_tokens(token_block_t*, size_t, size_t, const char*, size_t);
+void settle_block(token_block_t*);
 token_t expect_tok_array(token_t*);
 token_t expect_tok(token_t);
 void open_scanner_file(const char*);
+void open_scanner_fd(int, const char*);
 const char* get_file_name();
 int get_line_no();
 int get_column_no();
 const char* get_tok_str();
+tok_slice_t get_tok_slice();
+uint32_t get_tok_id();
+tok_value_t get_tok_value();
+const char* get_slice_text(tok_slice_t);
 token_t str_to_token(const char*);
 
 #endif
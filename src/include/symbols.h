@@ -55,20 +55,25 @@ typedef struct _symbol_t {
     name_type_t name_type;
     assignment_type_t assign_type;
     symbol_scope_t scope;
-    symbol_table_t table;
+    symbol_table_t* table;
     union {
         uint64_t uint_val;
         int64_t int_val;
         double float_val;
         char* str_val;
-        symbol_t* symbol;
+        struct _symbol_t* symbol;
     } const_val;
 } symbol_t;
 
 // defined in symbols.c
 void init_symbol_table();
+symbol_t* create_symbol();
+symbol_table_t* create_symbol_table(symbol_t* sym);
+void close_symbol_table();
+void destroy_symbol(symbol_t* sym);
 symbol_error_t add_symbol();
 symbol_error_t update_symbol(const char*, symbol_t*);
 symbol_error_t get_symbol(const char* name, symbol_t* sym);
+symbol_t* find_symbol(symbol_table_t*, const char*);
 
 #endif
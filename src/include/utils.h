@@ -8,6 +8,7 @@
 #include "errors.h"
 #include "files.h"
 #include "hashtable.h"
+#include "intern.h"
 #include "memory.h"
 #include "ptr_lists.h"
 
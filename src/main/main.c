@@ -1,4 +1,6 @@
 #include "common.h"
+#include <pthread.h>
+
 #include "scanner.h"
 #include "parser.h"
 
@@ -9,8 +11,131 @@ BEGIN_CONFIG
     CONFIG_LIST("-i", "FPATH", "Specify directories to search for imports", 0, ".:include", 0)
     CONFIG_BOOL("-D", "DFILE_ONLY", "Output the dot file only. No object output", 0, 0, 0)
     CONFIG_STR("-d", "DUMP_FILE", "Specify the file name to dump the AST into", 0, "ast_dump.dot", 1)
+    CONFIG_NUM("-j", "JOBS", "Number of threads that scan the input files ahead of parsing", 0, 1, 0)
 END_CONFIG
 
+/*
+    With -j, the input files are scanned by a pool of threads before parsing
+    starts. Each file is scanned by one thread into a block of tokens, and the
+    messages from scanning it are kept until the file is parsed. That way the
+    messages come out in the order of the input files, no matter how many
+    threads there are or which one finished first.
+*/
+#define SCAN_CHUNK  (0x01 << 12)
+
+typedef struct {
+    char* path;             // NULL if the file was not found
+    token_block_t* block;
+    char* msgs;             // messages from scanning the file
+    size_t msgs_len;
+} scan_job_t;
+
+static scan_job_t* scan_jobs = NULL;
+static int num_scan_jobs = 0;
+static int next_scan_job = 0;
+
+// Each file gets a scanner of its own, so the side buffer that is kept with
+// the block only has the strings of that file in it.
+static void scan_file(scan_job_t* job) {
+
+    scanner_t* scn = create_scanner();
+    bind_scanner(scn);
+
+    FILE* fp = open_memstream(&job->msgs, &job->msgs_len);
+    if(fp == NULL)
+        fatal_error("cannot create a message stream: %s", strerror(errno));
+
+    set_thread_err_stream(fp);
+    open_scanner_file(job->path);
+    job->block = create_token_block(SCAN_CHUNK);
+    do {
+        scan_tokens(job->block, SCAN_CHUNK);
+    } while(job->block->tok[job->block->count - 1] != END_OF_INPUT);
+    keep_block_text(job->block);
+    set_thread_err_stream(NULL);
+    fclose(fp);
+
+    destroy_scanner(scn);
+}
+
+static void* scan_worker(void* arg) {
+
+    (void)arg;
+
+    int idx;
+    while((idx = __atomic_fetch_add(&next_scan_job, 1, __ATOMIC_RELAXED)) < num_scan_jobs) {
+        if(scan_jobs[idx].path != NULL)
+            scan_file(&scan_jobs[idx]);
+    }
+
+    return NULL;
+}
+
+// The files are found here, because the search paths are not safe to use
+// from more than one thread.
+static void scan_ahead(int threads) {
+
+    for(char* str = iterate_config("INFILES"); str != NULL; str = iterate_config("INFILES"))
+        num_scan_jobs++;
+
+    if(num_scan_jobs == 0)
+        return;
+
+    scan_jobs = CALLOC(num_scan_jobs, sizeof(scan_job_t));
+    int idx = 0;
+    for(char* str = iterate_config("INFILES"); str != NULL; str = iterate_config("INFILES"))
+        scan_jobs[idx++].path = find_input_file(str);
+
+    if(threads > num_scan_jobs)
+        threads = num_scan_jobs;
+
+    pthread_t* tids = MALLOC(threads * sizeof(pthread_t));
+    for(int i = 0; i < threads; i++) {
+        int err = pthread_create(&tids[i], NULL, scan_worker, NULL);
+        if(err != 0)
+            fatal_error("cannot create a scanner thread: %s", strerror(err));
+    }
+
+    for(int i = 0; i < threads; i++)
+        pthread_join(tids[i], NULL);
+    FREE(tids);
+}
+
+// Called just before a file that was scanned ahead is parsed.
+static void release_scanned_file(int idx) {
+
+    scan_job_t* job = &scan_jobs[idx];
+
+    if(job->msgs != NULL) {
+        fwrite(job->msgs, 1, job->msgs_len, stderr);
+        free(job->msgs);    // from open_memstream()
+    }
+
+    if(job->path != NULL) {
+        add_scanned_file(job->path, job->block);
+        FREE(job->path);
+    }
+}
+
+// Called when parsing stops before all of the files that were scanned ahead
+// have been parsed. Their tokens and messages are thrown away.
+static void drop_scanned_files(int idx) {
+
+    for(; idx < num_scan_jobs; idx++) {
+        scan_job_t* job = &scan_jobs[idx];
+
+        if(job->msgs != NULL)
+            free(job->msgs);    // from open_memstream()
+        if(job->block != NULL)
+            destroy_token_block(job->block);
+        if(job->path != NULL)
+            FREE(job->path);
+    }
+
+    FREE(scan_jobs);
+    scan_jobs = NULL;
+}
+
 static void init_things(int argc, char** argv) {
 
     init_memory();
@@ -22,14 +147,24 @@ static void init_things(int argc, char** argv) {
 
 int main(int argc, char** argv) {
 
-    int retv;
+    int retv = 0;
+    int idx = 0;
 
     init_things(argc, argv);
+
+    if(GET_CONFIG_NUM("JOBS") > 1)
+        scan_ahead(GET_CONFIG_NUM("JOBS"));
+
     for(char* str = iterate_config("INFILES"); str != NULL; str = iterate_config("INFILES")) {
+        if(scan_jobs != NULL)
+            release_scanned_file(idx++);
         retv = parse(str);
         if(retv != 0)
             break;
     }
 
+    if(scan_jobs != NULL)
+        drop_scanned_files(idx);
+
     return retv;
 }
@@ -0,0 +1,148 @@
+/*
+    Module registry
+
+    Modules are known by the canonical path of the file and by a hash of what
+    is in it, so the same file imported through different paths, or a copy of
+    it in another directory, is loaded only once per compilation. Files with
+    the same hash are compared before they are taken to be the same module.
+*/
+#include "common.h"
+#include <inttypes.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "symbols.h"
+#include "modules.h"
+
+static hashtable_t* modules_by_path = NULL;
+static hashtable_t* modules_by_hash = NULL;
+static ptr_list_t* all_modules = NULL;
+
+// FNV-1a, 64 bit
+static uint64_t hash_mem(const unsigned char* buf, size_t len) {
+
+    uint64_t hash = 0xcbf29ce484222325;
+    for(size_t i = 0; i < len; i++) {
+        hash ^= buf[i];
+        hash *= 0x100000001b3;
+    }
+    return hash;
+}
+
+// Map the whole file. The size is 0 and NULL is returned for an empty file.
+static void* map_file(const char* fname, size_t* size) {
+
+    struct stat st;
+    void* ptr = NULL;
+
+    int fd = open(fname, O_RDONLY);
+    if(fd < 0)
+        fatal_error("Cannot open input file: \"%s\": %s", fname, strerror(errno));
+
+    *size = 0;
+    if(fstat(fd, &st) == 0 && st.st_size > 0) {
+        ptr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(ptr == MAP_FAILED)
+            fatal_error("Cannot read input file: \"%s\": %s", fname, strerror(errno));
+        *size = st.st_size;
+    }
+    close(fd);
+    return ptr;
+}
+
+static uint64_t hash_file(const char* fname) {
+
+    size_t size;
+    void* ptr = map_file(fname, &size);
+    uint64_t hash = hash_mem((const unsigned char*)ptr, size);
+    if(ptr != NULL)
+        munmap(ptr, size);
+    return hash;
+}
+
+// Files with the same hash are only the same module if the bytes are the same.
+static int same_contents(const char* fname1, const char* fname2) {
+
+    size_t size1, size2;
+    void* ptr1 = map_file(fname1, &size1);
+    void* ptr2 = map_file(fname2, &size2);
+
+    int same = (size1 == size2) && (size1 == 0 || !memcmp(ptr1, ptr2, size1));
+
+    if(ptr1 != NULL)
+        munmap(ptr1, size1);
+    if(ptr2 != NULL)
+        munmap(ptr2, size2);
+    return same;
+}
+
+// Called by atexit()
+static void destroy_modules() {
+
+    // the tables point to the modules in the list, only free them once
+    ptr_list_iter_t iter;
+    init_ptr_list_iter(&iter, all_modules);
+    for(module_t* mod = next_ptr_list_iter(&iter); mod != NULL; mod = next_ptr_list_iter(&iter)) {
+        if(mod->sym != NULL)
+            destroy_symbol(mod->sym);
+        FREE(mod->path);
+        FREE(mod);
+    }
+    destroy_ptr_list(all_modules);
+    destroy_hash_table(modules_by_path);
+    destroy_hash_table(modules_by_hash);
+}
+
+void init_modules() {
+
+    modules_by_path = create_hash_table();
+    modules_by_hash = create_hash_table();
+    all_modules = create_ptr_list();
+    atexit(destroy_modules);
+}
+
+/*
+    Find the module for the file, or make a new one if it has not been loaded
+    yet. When is_new is set, the caller has to load the module and set the
+    symbol that it is loaded into. The same module is returned for every path
+    that leads to the same file, and for files that have the same contents.
+*/
+module_t* load_module(const char* fname, int* is_new) {
+
+    module_t* mod = NULL;
+    char hash_key[24];
+
+    char* path = realpath(fname, NULL);
+    if(path == NULL)
+        fatal_error("Cannot find input file: \"%s\": %s", fname, strerror(errno));
+
+    *is_new = 0;
+    if(find_hash(modules_by_path, path, &mod, sizeof(mod)) == HASH_NO_ERROR) {
+        free(path);     // from realpath()
+        return mod;
+    }
+
+    uint64_t hash = hash_file(path);
+    snprintf(hash_key, sizeof(hash_key), "%016" PRIx64, hash);
+    if(find_hash(modules_by_hash, hash_key, &mod, sizeof(mod)) != HASH_NO_ERROR)
+        mod = NULL;
+    else if(!same_contents(mod->path, path))
+        mod = NULL;     // a different file with the same hash is not in the hash table
+
+    if(mod == NULL) {
+        mod = CALLOC(1, sizeof(module_t));
+        mod->path = STRDUP(path);
+        mod->hash = hash;
+        append_ptr_list(all_modules, mod);
+        // only the first file with a hash is found by it
+        insert_hash(modules_by_hash, hash_key, &mod, sizeof(mod));
+        *is_new = 1;
+    }
+
+    // another path to the same module is found with one lookup next time
+    insert_hash(modules_by_path, path, &mod, sizeof(mod));
+    free(path);
+    return mod;
+}
@@ -5,6 +5,7 @@
 #include "parser.h"
 #include "symbols.h"
 #include "files.h"
+#include "modules.h"
 
 #include "class_definition.h"
 #include "method_definition.h"
@@ -25,31 +26,83 @@ static const char* find_import(const char* fname) {
 // TODO: Import names are not strings. They are symbols that will be used
 // to access the elements of the imported file.
 
-// TODO: Implement that 'as' keyword for imports.
+// number of imported files that are being read, see end_of_file()
+static int modules_open = 0;
 
-// Open a file for import. Only read the class definitions to acquire
-// the symbols and type information.
+/*
+    Open a file for import. Only read the class definitions to acquire the
+    symbols and type information. A module is only loaded the first time it's
+    imported. Its symbols are added to a table of its own, which the registry
+    keeps. Importing it again binds the new name to the symbols that were
+    already loaded without scanning the file again.
+
+    import "name"
+    import "name" as symbol
+*/
 static parse_state_t import_statement() {
 
     token_t tok = expect_tok(QSTRG_TOKEN);
-    if(tok == QSTRG_TOKEN) {
-        // fatal error when file cannot be opened
-        open_input_file(get_tok_str());
-        //const char* tmp = get_tok_str();
-        //const char* fname = find_import_file(tmp);
-        //if(fname != NULL) {
-        //    open_scanner_file(fname);
-        //    return PARSE_TOP;
-        //}
-        //else
-        //    syntax("import could not be found: %s", tmp);
+    if(tok != QSTRG_TOKEN)
+        return PARSE_ERROR;
+
+    char* name = STRDUP(get_tok_str());
+    char* fname = find_input_file(name);
+    if(fname == NULL) {
+        syntax("import could not be found: %s", name);
+        FREE(name);
+        return PARSE_ERROR;
+    }
+
+    // the tokens looked at here are kept while the module is read
+    if(peek_tok(0) == AS_TOKEN) {
+        get_tok();
+        if(expect_tok(SYMBOL_TOKEN) == SYMBOL_TOKEN) {
+            FREE(name);
+            name = STRDUP(get_tok_str());
+        }
+    }
+
+    int is_new;
+    module_t* mod = load_module(fname, &is_new);
+    if(is_new) {
+        mod->sym = create_symbol();
+        mod->sym->name_type = SYM_IMPORT_TYPE;
+    }
+
+    // the name goes in the table of the importer
+    symbol_t sym;
+    memset(&sym, 0, sizeof(sym));
+    sym.name_type = SYM_IMPORT_TYPE;
+    sym.const_val.symbol = mod->sym;
+    add_symbol(name, &sym);
+
+    if(is_new) {
+        // the symbols of the module go in its own table until the file ends
+        create_symbol_table(mod->sym);
+        modules_open++;
+        open_scanner_file(fname);
     }
 
-    return PARSE_ERROR;
+    FREE(fname);
+    FREE(name);
+    return PARSE_TOP;
+}
+
+/*
+    A file has ended. If it's an imported module, its symbol table is done.
+    Modules are read to the end before the file that imported them goes on,
+    so the files end in the reverse of the order that they were opened.
+*/
+static void end_of_file() {
+
+    if(modules_open > 0) {
+        close_symbol_table();
+        modules_open--;
+    }
 }
 
 // Eat the rest of this block without detecting errors in an attempt to
-// get resynchronized.
+// get resynchronized. The end of a file also ends the block.
 static void eat_block() {
 
     // might want to adjust this for better error handling or detection.
@@ -57,8 +110,12 @@ static void eat_block() {
 
     while(!finished) {
         int tok = get_tok();
-        if(tok == OCUR_TOKEN || tok == CCUR_TOKEN)
+        if(tok == OCUR_TOKEN || tok == CCUR_TOKEN || tok == END_OF_INPUT)
+            finished++;
+        else if(tok == END_OF_FILE) {
+            end_of_file();
             finished++;
+        }
     }
 }
 
@@ -71,6 +128,7 @@ void init_parser() {
 
     // Create the symbol table and ant other data structures.
     init_symbol_table();
+    init_modules();
 
     atexit(uninit_parser);
 }
@@ -114,6 +172,9 @@ int parse(const char* fname) {
                         init_deco_str(); // throw away the name, if any
                         state = PARSE_ERROR;
                         break;
+                    case END_OF_FILE:
+                        end_of_file();
+                        break;
                     case END_OF_INPUT:
                         state = PARSE_ENDING;
                         break;
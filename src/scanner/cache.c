@@ -0,0 +1,332 @@
+/*
+    Token cache
+
+    When G_TOKCACHE names a directory, the tokens of every file that is opened
+    are kept there in a .gtok file, so that the next compile does not have to
+    scan the file again. A cache file is the token block of the file written
+    out as it is in memory:
+
+        header (gtok_header_t)
+        number values   count * 8 bytes
+        token kinds     count * int32
+        start offsets   count * uint32
+        lengths         count * uint32
+        side offsets    count * uint32
+        side lengths    count * uint32
+        symbols         count * uint32
+        side text       side_len bytes and a NUL
+        symbol names    sym_len bytes
+
+    Interned ids are only good for one run, so the names of the symbols in the
+    file are kept in the cache, each one once and ending with a NUL. The
+    symbol number of a token is which of those names it has, starting at 1,
+    or 0 if it's not a symbol. The names are interned again when the file is
+    opened, without reading the source.
+
+    The file is mapped and the arrays of the block point straight into it. So
+    opening a cached file is a stat(), an mmap() and a check of the header,
+    then one pass over the tokens to give them their file and interned ids.
+
+    A cache file is named after a hash of the canonical path of the source. It
+    is only used if it was made by the same version of the scanner, the size
+    and modification time of the source are the same as when it was made, and
+    the size of the cache file is what the header says it should be. Anything
+    else and the file is scanned again, so a cache file that was cut short or
+    left from an older version is never used.
+
+    Files that had errors or warnings when they were scanned are not cached,
+    because replaying them would not report them again.
+*/
+#include "common.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "scanner.h"
+#include "local.h"
+
+#define GTOK_MAGIC      (0x4b4f5447)    // "GTOK"
+
+// the token kinds are written as they are in memory
+_Static_assert(sizeof(token_t) == sizeof(int32_t), "token_t must be 32 bits");
+_Static_assert(sizeof(tok_value_t) == sizeof(uint64_t), "tok_value_t must be 64 bits");
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t size;          // of the source
+    int64_t mtime_sec;      // of the source
+    int64_t mtime_nsec;
+    uint32_t count;
+    uint32_t side_len;
+    uint32_t num_syms;
+    uint32_t sym_len;
+} gtok_header_t;
+
+// FNV-1a, 64 bit, for the name of the cache file
+static uint64_t hash_mem(const void* ptr, size_t len) {
+
+    const unsigned char* buf = (const unsigned char*)ptr;
+    uint64_t hash = 0xcbf29ce484222325;
+    for(size_t i = 0; i < len; i++) {
+        hash ^= buf[i];
+        hash *= 0x100000001b3;
+    }
+    return hash;
+}
+
+// Returns the name of the cache file for the source, which the caller must
+// free, or NULL if there is no cache.
+static char* cache_name(const char* fname) {
+
+    const char* dir = getenv("G_TOKCACHE");
+    if(dir == NULL || *dir == '\0')
+        return NULL;
+
+    char* path = realpath(fname, NULL);
+    if(path == NULL)
+        return NULL;
+
+    size_t len = strlen(dir) + 24;
+    char* name = MALLOC(len);
+    snprintf(name, len, "%s/%016lx.gtok", dir, hash_mem(path, strlen(path)));
+    free(path);     // from realpath()
+    return name;
+}
+
+static size_t cache_size(const gtok_header_t* hdr) {
+
+    return sizeof(gtok_header_t) +
+                (size_t)hdr->count * (sizeof(tok_value_t) + sizeof(int32_t) + 5 * sizeof(uint32_t)) +
+                hdr->side_len + 1 + hdr->sym_len;
+}
+
+// Intern the symbol names of the cache file. Returns the interned ids by
+// symbol number, which the caller must free, or NULL if the names are not
+// what the header says.
+static uint32_t* intern_symbols(const gtok_header_t* hdr, const char* names) {
+
+    uint32_t* ids = MALLOC(((size_t)hdr->num_syms + 1) * sizeof(uint32_t));
+    size_t pos = 0;
+
+    ids[0] = NO_INTERN_ID;
+    for(uint32_t i = 1; i <= hdr->num_syms; i++) {
+        const char* end = memchr(&names[pos], '\0', hdr->sym_len - pos);
+        if(end == NULL || end == &names[pos]) {
+            FREE(ids);
+            return NULL;
+        }
+        ids[i] = intern_mem(&names[pos], end - &names[pos]);
+        pos = (end - names) + 1;
+    }
+
+    if(pos != hdr->sym_len) {
+        FREE(ids);
+        return NULL;
+    }
+    return ids;
+}
+
+// Map the cache file and make a block out of it if it's good for the source.
+// Returns NULL if it's not.
+static token_block_t* read_cache(const char* cname, const struct stat* src_st, int file_id) {
+
+    struct stat st;
+    int fd = open(cname, O_RDONLY);
+    if(fd < 0)
+        return NULL;
+
+    if(fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(gtok_header_t)) {
+        close(fd);
+        return NULL;
+    }
+
+    char* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED)
+        return NULL;
+
+    const gtok_header_t* hdr = (const gtok_header_t*)map;
+    if(hdr->magic != GTOK_MAGIC || hdr->version != GTOK_VERSION ||
+                hdr->size != (uint64_t)src_st->st_size ||
+                hdr->mtime_sec != (int64_t)src_st->st_mtim.tv_sec ||
+                hdr->mtime_nsec != (int64_t)src_st->st_mtim.tv_nsec ||
+                hdr->count == 0 || hdr->count > INT32_MAX ||
+                cache_size(hdr) != (size_t)st.st_size) {
+        munmap(map, st.st_size);
+        return NULL;
+    }
+
+    token_block_t* block = (token_block_t*)CALLOC(1, sizeof(token_block_t));
+    char* ptr = map + sizeof(gtok_header_t);
+    block->count = block->capacity = hdr->count;
+    // the values come first so that they are aligned
+    block->value = (tok_value_t*)ptr;
+    ptr += hdr->count * sizeof(tok_value_t);
+    block->tok = (token_t*)ptr;
+    ptr += hdr->count * sizeof(int32_t);
+    block->start = (uint32_t*)ptr;
+    ptr += hdr->count * sizeof(uint32_t);
+    block->length = (uint32_t*)ptr;
+    ptr += hdr->count * sizeof(uint32_t);
+    block->side = (uint32_t*)ptr;
+    ptr += hdr->count * sizeof(uint32_t);
+    block->side_length = (uint32_t*)ptr;
+    ptr += hdr->count * sizeof(uint32_t);
+    const uint32_t* syms = (const uint32_t*)ptr;
+    ptr += hdr->count * sizeof(uint32_t);
+    block->side_text = ptr;
+    block->side_len = hdr->side_len;
+    ptr += hdr->side_len + 1;
+    block->map = map;
+    block->map_len = st.st_size;
+
+    // the file id and the interned ids are not known until the block is used
+    block->file_id = MALLOC(hdr->count * sizeof(int));
+    block->id = MALLOC(hdr->count * sizeof(uint32_t));
+
+    uint32_t* ids = intern_symbols(hdr, ptr);
+    int good = (ids != NULL && block->tok[block->count - 1] == END_OF_INPUT &&
+                block->side_text[block->side_len] == '\0');
+
+    for(int i = 0; good && i < block->count; i++) {
+        if(syms[i] > hdr->num_syms)
+            good = 0;
+        else {
+            block->file_id[i] = (block->tok[i] == END_OF_INPUT)? -1: file_id;
+            block->id[i] = ids[syms[i]];
+        }
+    }
+
+    if(ids != NULL)
+        FREE(ids);
+    if(!good) {
+        destroy_token_block(block);
+        return NULL;
+    }
+    return block;
+}
+
+// Write the block to a temporary file and then rename it, so a cache file
+// that is being written is never read. The temporary file has a name of its
+// own, so threads that write the same cache file at once do not mix them.
+static void write_cache(const char* cname, token_block_t* block, const struct stat* src_st) {
+
+    gtok_header_t hdr;
+    size_t len = strlen(cname) + 8;
+    char* tmp = MALLOC(len);
+    snprintf(tmp, len, "%s.XXXXXX", cname);
+
+    int fd = mkstemp(tmp);
+    FILE* fp = (fd < 0)? NULL: fdopen(fd, "wb");
+    if(fp == NULL) {
+        if(fd >= 0) {
+            close(fd);
+            unlink(tmp);
+        }
+        FREE(tmp);
+        return;
+    }
+
+    // number the symbols in the order that they are first seen
+    uint32_t* nums = CALLOC(get_intern_count(), sizeof(uint32_t));
+    uint32_t* syms = MALLOC(block->count * sizeof(uint32_t));
+    uint32_t* order = MALLOC(block->count * sizeof(uint32_t));
+
+    memset(&hdr, 0, sizeof(hdr));
+    for(int i = 0; i < block->count; i++) {
+        uint32_t id = block->id[i];
+        if(id != NO_INTERN_ID && nums[id] == 0) {
+            order[hdr.num_syms++] = id;
+            nums[id] = hdr.num_syms;
+            hdr.sym_len += get_intern_len(id) + 1;
+        }
+        syms[i] = (id != NO_INTERN_ID)? nums[id]: 0;
+    }
+
+    hdr.magic = GTOK_MAGIC;
+    hdr.version = GTOK_VERSION;
+    hdr.size = src_st->st_size;
+    hdr.mtime_sec = src_st->st_mtim.tv_sec;
+    hdr.mtime_nsec = src_st->st_mtim.tv_nsec;
+    hdr.count = block->count;
+    hdr.side_len = block->side_len;
+
+    int ok = fwrite(&hdr, sizeof(hdr), 1, fp) == 1;
+    ok = ok && fwrite(block->value, sizeof(tok_value_t), block->count, fp) == (size_t)block->count;
+    ok = ok && fwrite(block->tok, sizeof(int32_t), block->count, fp) == (size_t)block->count;
+    ok = ok && fwrite(block->start, sizeof(uint32_t), block->count, fp) == (size_t)block->count;
+    ok = ok && fwrite(block->length, sizeof(uint32_t), block->count, fp) == (size_t)block->count;
+    ok = ok && fwrite(block->side, sizeof(uint32_t), block->count, fp) == (size_t)block->count;
+    ok = ok && fwrite(block->side_length, sizeof(uint32_t), block->count, fp) == (size_t)block->count;
+    ok = ok && fwrite(syms, sizeof(uint32_t), block->count, fp) == (size_t)block->count;
+    ok = ok && fwrite(block->side_text, 1, block->side_len + 1, fp) == block->side_len + 1;
+    for(uint32_t i = 0; ok && i < hdr.num_syms; i++)
+        ok = fwrite(get_intern_str(order[i]), 1, get_intern_len(order[i]) + 1, fp) ==
+                    get_intern_len(order[i]) + 1;
+    ok = (fclose(fp) == 0) && ok;
+
+    FREE(nums);
+    FREE(syms);
+    FREE(order);
+
+    if(!ok || rename(tmp, cname) != 0)
+        unlink(tmp);
+    FREE(tmp);
+}
+
+// Scan the whole file with a scanner of its own, so the scanner that is in
+// use is not disturbed. Only the messages of this thread are counted, since
+// other threads may be scanning at the same time.
+static token_block_t* scan_whole_file(int file_id, int* clean) {
+
+    int msgs = get_thread_num_msgs();
+    scanner_t* prev = bind_scanner(create_scanner());
+
+    push_source(file_id, NULL);
+    token_block_t* block = create_token_block(0x01 << 12);
+    do {
+        scan_tokens(block, 0x01 << 12);
+    } while(block->tok[block->count - 1] != END_OF_INPUT);
+    keep_block_text(block);
+
+    destroy_scanner(get_scanner());
+    bind_scanner(prev);
+
+    *clean = (get_thread_num_msgs() == msgs);
+    return block;
+}
+
+/*
+    Get the tokens of the file from the cache. If they are not there, then the
+    file is scanned and the cache is written. Returns NULL if there is no
+    cache, in which case the file is scanned as it's read.
+*/
+token_block_t* cached_tokens(const char* fname) {
+
+    struct stat st;
+    int clean;
+
+    char* cname = cache_name(fname);
+    if(cname == NULL)
+        return NULL;
+
+    if(stat(fname, &st) < 0 || !S_ISREG(st.st_mode)) {
+        FREE(cname);
+        return NULL;
+    }
+
+    // the source is mapped, not read, so this costs little
+    int file_id = load_source(fname);
+
+    token_block_t* block = read_cache(cname, &st, file_id);
+    if(block == NULL) {
+        block = scan_whole_file(file_id, &clean);
+        if(clean)
+            write_cache(cname, block, &st);
+    }
+
+    FREE(cname);
+    return block;
+}
@@ -0,0 +1,45 @@
+/*
+    Character classes
+
+    One table entry per byte value, so classifying a character is a single
+    indexed load with no calls into the C library and no locale. The classes
+    are bits so that a character can be in more than one, such as a hex
+    letter which is also an identifier character. Bytes above 0x7F are in no
+    class, the same as the "C" locale.
+
+    END_FILE and END_INPUT from get_char() are control characters, so they are
+    in no class either.
+*/
+#include "common.h"
+
+#include "scanner.h"
+#include "local.h"
+
+#define ALPHA   (CC_IDENT_START | CC_IDENT)
+#define HEXA    (CC_IDENT_START | CC_IDENT | CC_HEX)
+
+const unsigned char char_class[256] = {
+    ['\t' ... '\r'] = CC_SPACE,
+    [' '] = CC_SPACE,
+
+    ['0' ... '7'] = CC_DIGIT | CC_OCTAL | CC_HEX | CC_IDENT,
+    ['8' ... '9'] = CC_DIGIT | CC_HEX | CC_IDENT,
+
+    ['A' ... 'F'] = HEXA,
+    ['G' ... 'Z'] = ALPHA,
+    ['a' ... 'f'] = HEXA,
+    ['g' ... 'z'] = ALPHA,
+    ['_'] = ALPHA,
+
+    ['\"'] = CC_QUOTE,
+    ['\''] = CC_QUOTE,
+
+    ['!'] = CC_OPER, ['#'] = CC_OPER, ['$'] = CC_OPER, ['%'] = CC_OPER,
+    ['&'] = CC_OPER, ['('] = CC_OPER, [')'] = CC_OPER, ['*'] = CC_OPER,
+    ['+'] = CC_OPER, [','] = CC_OPER, ['-'] = CC_OPER, ['.'] = CC_OPER,
+    ['/'] = CC_OPER, [':'] = CC_OPER, [';'] = CC_OPER, ['<'] = CC_OPER,
+    ['='] = CC_OPER, ['>'] = CC_OPER, ['?'] = CC_OPER, ['@'] = CC_OPER,
+    ['['] = CC_OPER, ['\\'] = CC_OPER, [']'] = CC_OPER, ['^'] = CC_OPER,
+    ['`'] = CC_OPER, ['{'] = CC_OPER, ['|'] = CC_OPER, ['}'] = CC_OPER,
+    ['~'] = CC_OPER,
+};
@@ -0,0 +1,145 @@
+/*
+    Keyword table generator
+
+    This is run as a part of the build. It reads the keyword list (see
+    tests/keywordlist.txt) and writes a header that holds a collision free hash
+    table of the keywords. The hash of a word is made from its length and its
+    first and last characters, so looking up a keyword is one hash and one
+    memcmp().
+
+    Each line of the keyword list looks like this:
+        {"and", AND_TOKEN},
+
+    Use: gen_keywords keywordlist.txt output.h
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_KEYWORDS    (256)
+#define MAX_WORD        (64)
+#define MAX_TABLE       (4096)
+#define MAX_MULT        (64)
+
+typedef struct {
+    char word[MAX_WORD];
+    char tok[MAX_WORD];
+    size_t len;
+} keyword_t;
+
+static keyword_t keywords[MAX_KEYWORDS];
+static int num_keywords = 0;
+
+static void read_list(const char* fname) {
+
+    char line[256];
+    FILE* fp = fopen(fname, "r");
+    if(fp == NULL) {
+        fprintf(stderr, "gen_keywords: cannot open %s\n", fname);
+        exit(1);
+    }
+
+    while(fgets(line, sizeof(line), fp) != NULL) {
+        keyword_t* kw = &keywords[num_keywords];
+        if(sscanf(line, " {\"%63[^\"]\" , %63[A-Z_]", kw->word, kw->tok) != 2)
+            continue;
+
+        if(num_keywords + 1 >= MAX_KEYWORDS) {
+            fprintf(stderr, "gen_keywords: too many keywords\n");
+            exit(1);
+        }
+        kw->len = strlen(kw->word);
+        num_keywords++;
+    }
+    fclose(fp);
+
+    if(num_keywords == 0) {
+        fprintf(stderr, "gen_keywords: no keywords found in %s\n", fname);
+        exit(1);
+    }
+}
+
+static unsigned hash(const keyword_t* kw, unsigned a, unsigned b, unsigned c, unsigned mask) {
+
+    return (kw->len * a +
+            (unsigned char)kw->word[0] * b +
+            (unsigned char)kw->word[kw->len - 1] * c) & mask;
+}
+
+// Try the multipliers on a table size. Returns non-zero if there are no
+// collisions.
+static int try_hash(unsigned a, unsigned b, unsigned c, unsigned size) {
+
+    static unsigned char used[MAX_TABLE];
+
+    memset(used, 0, size);
+    for(int i = 0; i < num_keywords; i++) {
+        unsigned h = hash(&keywords[i], a, b, c, size - 1);
+        if(used[h])
+            return 0;
+        used[h] = 1;
+    }
+    return 1;
+}
+
+int main(int argc, char** argv) {
+
+    unsigned a, b, c, size;
+
+    if(argc != 3) {
+        fprintf(stderr, "use: gen_keywords keywordlist.txt output.h\n");
+        return 1;
+    }
+    read_list(argv[1]);
+
+    for(size = 1; size < (unsigned)num_keywords; size <<= 1)
+        ;
+
+    // smallest table first, then the smallest multipliers
+    for(; size <= MAX_TABLE; size <<= 1)
+        for(a = 1; a < MAX_MULT; a++)
+            for(b = 1; b < MAX_MULT; b++)
+                for(c = 1; c < MAX_MULT; c++)
+                    if(try_hash(a, b, c, size))
+                        goto found;
+
+    fprintf(stderr, "gen_keywords: cannot find a perfect hash for the keywords\n");
+    return 1;
+
+found:
+    {
+        size_t min_len = keywords[0].len, max_len = keywords[0].len;
+        for(int i = 1; i < num_keywords; i++) {
+            if(keywords[i].len < min_len)
+                min_len = keywords[i].len;
+            if(keywords[i].len > max_len)
+                max_len = keywords[i].len;
+        }
+
+        FILE* fp = fopen(argv[2], "w");
+        if(fp == NULL) {
+            fprintf(stderr, "gen_keywords: cannot open %s\n", argv[2]);
+            return 1;
+        }
+
+        const char* base = strrchr(argv[1], '/');
+        fprintf(fp, "/*\n    Generated by gen_keywords from %s. Do not edit.\n*/\n",
+                    (base != NULL)? base + 1: argv[1]);
+        fprintf(fp, "#ifndef __KEYWORDS_H__\n#define __KEYWORDS_H__\n\n");
+        fprintf(fp, "#define KEYWORD_MIN_LEN     (%zu)\n", min_len);
+        fprintf(fp, "#define KEYWORD_MAX_LEN     (%zu)\n", max_len);
+        fprintf(fp, "#define KEYWORD_TABLE_SIZE  (%u)\n\n", size);
+        fprintf(fp, "#define KEYWORD_HASH(s, n) \\\n"
+                    "    (((n) * %uu + (unsigned char)(s)[0] * %uu + \\\n"
+                    "      (unsigned char)(s)[(n)-1] * %uu) & (KEYWORD_TABLE_SIZE - 1))\n\n",
+                    a, b, c);
+        fprintf(fp, "static const token_map_t keyword_table[KEYWORD_TABLE_SIZE] = {\n");
+        for(int i = 0; i < num_keywords; i++)
+            fprintf(fp, "    [%u] = {\"%s\", %zu, %s},\n",
+                    hash(&keywords[i], a, b, c, size - 1),
+                    keywords[i].word, keywords[i].len, keywords[i].tok);
+        fprintf(fp, "};\n\n#endif\n");
+        fclose(fp);
+    }
+    return 0;
+}
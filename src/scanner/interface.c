@@ -1,7 +1,10 @@
 
 #include "common.h"
+#include <unistd.h>
+
 #include "scanner.h"
 #include "local.h"
+#include "keywords.h"
 
 // when this is entered, a (/) has been seen. If the next character is a
 // (/) or a (*), then we have a comment, otherwise we have a / operator.
@@ -29,11 +32,30 @@ static token_t comment_or_operator() {
     return END_OF_INPUT;
 }
 
+// the scanner that init_scanner() creates for the main thread
+static scanner_t* default_scanner = NULL;
+
 // Called by atexit()
-static void destroy_scanner() {
-    destroy_char_buffer(scanner_buffer);
-    while(top != NULL)
-        close_file();
+static void destroy_default_scanner() {
+    destroy_scanner(default_scanner);
+    free_sources();
+}
+
+/*
+    Look up a word of the given length in the keyword hash table. The table is
+    generated from tests/keywordlist.txt at build time by gen_keywords. If the
+    word is not a keyword then SYMBOL_TOKEN is returned.
+*/
+token_t find_keyword(const char* str, size_t len) {
+
+    if(len < KEYWORD_MIN_LEN || len > KEYWORD_MAX_LEN)
+        return SYMBOL_TOKEN;
+
+    const token_map_t* kw = &keyword_table[KEYWORD_HASH(str, len)];
+    if(kw->len == len && !memcmp(str, kw->str, len))
+        return kw->tok;
+
+    return SYMBOL_TOKEN;
 }
 
 /*
@@ -44,26 +66,7 @@ static void destroy_scanner() {
 */
 token_t str_to_token(const char* str) {
 
-    // simple binary search
-    token_t retv = SYMBOL_TOKEN;
-    int start = 0, end = token_map_size - 1;
-    int mid = (start + end) / 2;
-
-    while(start <= end) {
-        int spot = strcmp(str, token_map[mid].str);
-        if(spot > 0)
-            start = mid + 1;
-        else if(spot < 0)
-            end = mid - 1;
-        else {
-            retv = token_map[mid].tok;
-            break;
-        }
-
-        mid = (start + end) / 2;
-    }
-
-    return retv;
+    return find_keyword(str, strlen(str));
 }
 
 const char* token_to_str(token_t tok) {
@@ -74,30 +77,110 @@ const char* token_to_str(token_t tok) {
 
 /*
     Create the data for the scanner. This must be called befoer any other
-    scanner function.
+    scanner function. It creates the default scanner and binds it to the
+    calling thread.
 */
 void init_scanner() {
 
-    scanner_buffer = create_char_buffer();
-    atexit(destroy_scanner);
+    default_scanner = create_scanner();
+    bind_scanner(default_scanner);
+    atexit(destroy_default_scanner);
+    init_intern();
 }
 
 /*
-    Returns the token in the token structure provided.
+    Create a scanner with no files open. It must be bound to a thread with
+    bind_scanner() before it's used. The sources that it loads are shared
+    with the other scanners and are kept until exit.
 */
-token_t get_tok() {
+scanner_t* create_scanner() {
+
+    scanner_t* scn = (scanner_t*)CALLOC(1, sizeof(scanner_t));
+    scn->scanner_buffer = create_char_buffer();
+    scn->string_buffer = create_char_buffer();
+    scn->tok_slice.file_id = SLICE_SIDE_BUFFER;
+    clear_tok_info(&scn->cur_tok);
+    return scn;
+}
+
+/*
+    Close the files that the scanner still has open and free it. If it's
+    bound to the calling thread, then the thread is left with no scanner.
+*/
+void destroy_scanner(scanner_t* scn) {
+
+    if(scn == NULL)
+        return;
+
+    scanner_t* prev = bind_scanner(scn);
+    while(scn->top != NULL)
+        close_file();
+
+    if(scn->scanned != NULL) {
+        // blocks for files that were never opened
+        // scanners are destroyed by their own threads, so this walk is not shared
+        hash_iter_t iter;
+        init_hash_iter(&iter, scn->scanned);
+        while(next_hash_iter(&iter) != NULL)
+            destroy_token_block(*(token_block_t**)get_hash_iter_data(&iter));
+        destroy_hash_table(scn->scanned);
+    }
+    destroy_char_buffer(scn->scanner_buffer);
+    destroy_char_buffer(scn->string_buffer);
+    FREE(scn);
+    bind_scanner((prev == scn)? NULL: prev);
+}
+
+/*
+    Make the scanner the one that the scanner functions use in the calling
+    thread. Returns the scanner that was bound before, or NULL.
+*/
+scanner_t* bind_scanner(scanner_t* scn) {
+
+    scanner_t* prev = scanner;
+    scanner = scn;
+    return prev;
+}
+
+// Return the scanner that is bound to the calling thread.
+scanner_t* get_scanner() {
+
+    return scanner;
+}
+
+// A token record with no text and no position.
+void clear_tok_info(token_info_t* info) {
+
+    memset(info, 0, sizeof(token_info_t));
+    info->tok = NONE_TOKEN;
+    info->slice.file_id = SLICE_SIDE_BUFFER;
+    info->file_id = -1;
+}
+
+/*
+    Scan the next token from the input and fill in the record provided. The
+    parser gets tokens through the token ring in tokens.c.
+*/
+token_t scan_token(token_info_t* info) {
 
     int ch, finished = 0;
     token_t tok = NONE_TOKEN;
+    size_t start = 0;
+
+    close_ended_files();
+    if(scanner->top != NULL && scanner->top->block != NULL)
+        return replay_token(info);
 
     skip_ws();
-    init_char_buffer(scanner_buffer);
+    info->file_id = (scanner->top != NULL)? scanner->top->file_id: -1;
+    scanner->num_value.uint_val = 0;
 
     while(!finished) {
+        start = (scanner->top != NULL)? scanner->top->index: 0;
         ch = get_char();
         switch(ch) {
             case END_FILE:
-                file_flag++;
+                scanner->file_flag++;
                 tok = END_OF_FILE;
                 finished++;
                 break;
@@ -105,46 +188,54 @@ token_t get_tok() {
                 tok = END_OF_INPUT;
                 finished ++;
                 break;
-            case '\"':  // read a double quoted string
+            case '\"':  // read a double quoted string, sets the slice
                 tok = read_dquote();
                 finished ++;
-                break;
-            case '\'': // read a single quoted string
+                continue;
+            case '\'': // read a single quoted string, sets the slice
                 tok = read_squote();
                 finished ++;
-                break;
+                continue;
             case '/': // may have a comment or an operator
                 tok = comment_or_operator();
-                skip_ws();
                 if(tok != NONE_TOKEN)
                     finished ++;
-                // continue if it was a comment
+                else
+                    skip_ws(); // continue if it was a comment
                 break;
-            default:
-                if(ch == END_FILE)
-                    unget_char(ch);
-                else if(isdigit(ch)) { // beginning of a number. Could be hex, dec, or float
-                    unget_char(ch);
-                    tok = read_number_top();
-                    if(tok != NONE_TOKEN)
-                        finished ++;
-                }
-                else if(isalpha(ch)) { // could be a symbol or a keyword
-                    unget_char(ch);
-                    tok = read_word();
-                    if(tok != NONE_TOKEN)
-                        finished++;
-                }
-                else if(ispunct(ch)) { // some kind of operator (but not a '/' or a quote)
-                    tok = read_punct(ch);
-                    if(tok != NONE_TOKEN)
-                        finished ++;
-                }
-                else {
-                    warning("Unknown character, ignoring. (0x%02X) (%d) \'%c\'", ch, ch, ch);
+            default: {
+                    int cls = char_class[ch];
+                    if(cls & CC_DIGIT) { // beginning of a number. Could be hex, dec, or float
+                        unget_char(ch);
+                        tok = read_number_top();
+                        if(tok != NONE_TOKEN)
+                            finished ++;
+                    }
+                    else if(cls & CC_IDENT_START) { // could be a symbol or a keyword
+                        unget_char(ch);
+                        tok = read_word();
+                        if(tok != NONE_TOKEN)
+                            finished++;
+                    }
+                    else if(cls & CC_OPER) { // some kind of operator (but not a '/' or a quote)
+                        tok = read_punct(ch);
+                        if(tok != NONE_TOKEN)
+                            finished ++;
+                    }
+                    else {
+                        warning("Unknown character, ignoring. (0x%02X) (%d) \'%c\'", ch, ch, ch);
+                    }
                 }
         }
+        set_tok_slice(start);
     }
+
+    info->tok = tok;
+    info->slice = scanner->tok_slice;
+    info->id = (tok == SYMBOL_TOKEN)? scanner->tok_id: NO_INTERN_ID;
+    info->value = scanner->num_value;
+    info->start = start;
+    info->end = (scanner->top != NULL)? scanner->top->index: 0;
     return tok;
 }
 
@@ -178,50 +269,162 @@ token_t expect_tok_array(token_t* arr) {
 
 /*
     Retrieve the next token and check it against the specified token type. If
-    they do not match then create a syntax error and unget the characters that
-    made up the token. If the type matches, then copy the token to the buf and
-    return it. If the buf parameter is NULL, then do not try to copy to the
-    buffer.
+    they do not match then create a syntax error and unget the token, so the
+    caller can use it to recover. If the type matches, then return it. The
+    text of the token is available from get_tok_str().
 */
 token_t expect_tok(token_t tok) {
 
     token_t token = get_tok();
     if(token != tok) {
         syntax("expected a %s but got a %s.", token_to_str(tok), token_to_str(token));
+        unget_tok();
         return ERROR_TOKEN;
     }
     else
         return token;
 }
 
+/*
+    Give the scanner the tokens of a file that were scanned ahead of time, such
+    as by another thread with scan_tokens(). When the file is opened, the tokens
+    are taken from the block instead of scanning the file again. The block must
+    hold the whole file and the scanner owns it after this.
+*/
+void add_scanned_file(const char* fname, token_block_t* block) {
+
+    if(block == NULL || block->count == 0 || block->file_id[block_slot(block, 0)] < 0) {
+        destroy_token_block(block);
+        return;
+    }
+
+    if(scanner->scanned == NULL)
+        scanner->scanned = create_hash_table();
+
+    // the first one given for a file is the one that is used
+    if(insert_hash(scanner->scanned, fname, &block, sizeof(block)) != HASH_NO_ERROR)
+        destroy_token_block(block);
+}
+
+// Take the block of a file that was scanned ahead of time, if there is one.
+// It's only used once.
+static token_block_t* take_scanned_file(const char* fname) {
+
+    token_block_t* block = NULL;
+
+    if(scanner->scanned == NULL || fname == NULL)
+        return NULL;
+
+    if(find_hash(scanner->scanned, fname, &block, sizeof(block)) != HASH_NO_ERROR)
+        return NULL;
+
+    if(block != NULL) {
+        token_block_t* none = NULL;
+        replace_hash_data(scanner->scanned, fname, &none, sizeof(none));
+    }
+    return block;
+}
+
 /*
     Open a file. This pushes the file onto a file stack and causes get_tok() to
     begin scanning the file. When the file ends, then scanning resumes where it
     left off when a new file was opened. It is encumbent on the caller to make
     sure that open_file is called between tokens.
+
+    Tokens that were scanned ahead of the parser are set aside until the new
+    file has been read, so they are returned after the tokens of the new file.
+
+    The name "-" is the standard input, see open_scanner_fd().
 */
 void open_scanner_file(const char* fname) {
 
-    nest_depth++;
-    if(nest_depth > MAX_FILE_NESTING) {
-        fatal_error("Maximum file nesting depth exceeded.");
-        exit(1);
+    if(!strcmp(fname, "-")) {
+        open_scanner_fd(STDIN_FILENO, "stdin");
+        return;
     }
 
-    FILE* fp = fopen(fname, "r");
-    if(fp == NULL) {
-        fatal_error("Cannot open input file: \"%s\": %s", fname, strerror(errno));
+    token_block_t* block = take_scanned_file(fname);
+    if(block == NULL)
+        block = cached_tokens(fname);
+    push_file(fname, block);
+}
+
+/*
+    Open a file descriptor, such as a pipe, the same way as a file. It's read
+    in large blocks as the tokens are needed, so scanning starts before the
+    writer has finished. The name is used in messages. The file descriptor is
+    closed when all of it has been read.
+*/
+void open_scanner_fd(int fd, const char* name) {
+
+    push_source(load_stream(fd, name), NULL);
+}
+
+/*
+    Push the file on the file stack. If a block is given, then the tokens are
+    taken from it instead of scanning the file.
+*/
+void push_file(const char* fname, token_block_t* block) {
+
+    push_source((block != NULL)? block->file_id[block_slot(block, 0)]: load_source(fname), block);
+}
+
+// Put a new file on the file stack. The caller sets up the buffer.
+static void push_stack(int file_id, token_block_t* block) {
+
+    scanner->nest_depth++;
+    if(scanner->nest_depth > MAX_FILE_NESTING) {
+        fatal_error("Maximum file nesting depth exceeded.");
+        exit(1);
     }
 
     file_stack_t* fstk = (file_stack_t*)CALLOC(1, sizeof(file_stack_t));
-    fstk->fname = STRDUP(fname);
-    fstk->fp = fp;
-    fstk->line_no = 1;
-    fstk->col_no = 1;
-
-    if(top != NULL)
-        fstk->next = top;
-    top = fstk;
+    fstk->block = block;
+    fstk->file_id = file_id;
+    fstk->src = get_source(fstk->file_id);
+    fstk->length = fstk->src->length;
+    fstk->nstash = stash_tokens(&fstk->stash);
+    fstk->stash_flag = scanner->file_flag;
+    scanner->file_flag = 0;
+
+    if(scanner->top != NULL)
+        fstk->next = scanner->top;
+    scanner->top = fstk;
+}
+
+/*
+    Push a source that has already been loaded. A source that has been edited
+    is read from a copy of its text in one piece, so that the source is not
+    changed by reading it. Scanning the file costs more than the copy does.
+*/
+void push_source(int file_id, token_block_t* block) {
+
+    push_stack(file_id, block);
+    if(block == NULL)
+        scanner->top->copy = join_source(scanner->top->src);
+    scanner->top->buffer = (scanner->top->copy != NULL)? scanner->top->copy: scanner->top->src->buffer;
+}
+
+/*
+    Push a source to be scanned from the offset given. The gap that an edit
+    left in the source is moved to the offset instead of being closed, so only
+    the text between the two is moved. See relex.c.
+*/
+void push_source_from(int file_id, size_t offset) {
+
+    push_stack(file_id, NULL);
+    scanner->top->buffer = source_from(scanner->top->src, offset);
+    scanner->top->index = offset;
+}
+
+/*
+    The position that is reported is that of the last token taken by the
+    parser. While the scanner is reading ahead, it's the scanner's own
+    position, so scanner errors point at the right place.
+*/
+static int use_cursor() {
+
+    return scanner->scanning || !have_tok();
 }
 
 /*
@@ -230,10 +433,17 @@ void open_scanner_file(const char* fname) {
 */
 const char* get_file_name() {
 
-    if(top != NULL)
-        return top->fname;
-    else
+    if(scanner == NULL)
         return "no open file";
+
+    if(use_cursor()) {
+        if(scanner->top != NULL)
+            return scanner->top->src->fname;
+    }
+    else if(scanner->cur_tok.file_id >= 0)
+        return get_source(scanner->cur_tok.file_id)->fname;
+
+    return "no open file";
 }
 
 /*
@@ -242,10 +452,16 @@ const char* get_file_name() {
 */
 int get_line_no() {
 
-    if(top != NULL)
-        return top->line_no;
-    else
-        return -1;
+    int line = -1;
+    if(scanner == NULL)
+        return line;
+    if(use_cursor()) {
+        if(scanner->top != NULL)
+            locate_offset(scanner->top->src, scanner->top->index, &line, NULL);
+    }
+    else if(scanner->cur_tok.file_id >= 0)
+        locate_offset(get_source(scanner->cur_tok.file_id), scanner->cur_tok.end, &line, NULL);
+    return line;
 }
 
 /*
@@ -254,15 +470,77 @@ int get_line_no() {
 */
 int get_column_no() {
 
-    if(top != NULL)
-        return top->col_no;
-    else
-        return -1;
+    int col = -1;
+    if(scanner == NULL)
+        return col;
+    if(use_cursor()) {
+        if(scanner->top != NULL)
+            locate_offset(scanner->top->src, scanner->top->index, NULL, &col);
+    }
+    else if(scanner->cur_tok.file_id >= 0)
+        locate_offset(get_source(scanner->cur_tok.file_id), scanner->cur_tok.end, NULL, &col);
+    return col;
 }
 
 /*
-    Return the token string.
+    Return the token string. Text that is still in the source is copied to the
+    scanner buffer the first time it's asked for, so tokens whose string is
+    never used are never copied.
 */
 const char* get_tok_str() {
-    return get_char_buffer(scanner_buffer);
+
+    if(scanner->cur_tok.slice.length == 0)
+        return "";
+    else if(scanner->cur_tok.slice.file_id == SLICE_SIDE_BUFFER)
+        return get_char_buffer(scanner->string_buffer) + scanner->cur_tok.slice.offset;
+
+    if(!scanner->tok_str_ready) {
+        truncate_char_buffer(scanner->scanner_buffer, 0);
+        add_char_buffer_mem(scanner->scanner_buffer, get_slice_text(scanner->cur_tok.slice), scanner->cur_tok.slice.length);
+        scanner->tok_str_ready++;
+    }
+    return get_char_buffer(scanner->scanner_buffer);
+}
+
+/*
+    Return the slice of the last token read. The text is not copied.
+*/
+tok_slice_t get_tok_slice() {
+    return scanner->cur_tok.slice;
+}
+
+/*
+    Return the interned id of the last token read if it's a symbol, or
+    NO_INTERN_ID if it's not. Symbols with the same name have the same id in
+    every thread.
+*/
+uint32_t get_tok_id() {
+    return scanner->cur_tok.id;
+}
+
+/*
+    Return the value of the last token read if it's a number. Numbers that
+    do not fit were reported when they were scanned and are returned as an
+    ERROR_TOKEN, so they have no value.
+*/
+tok_value_t get_tok_value() {
+    return scanner->cur_tok.value;
+}
+
+/*
+    Return a pointer to the first character of the slice. The text is not
+    terminated; use the length in the slice. The side buffer keeps the text of
+    every string with an escape that the scanner reads, until the scanner is
+    destroyed. The buffer is moved when it grows, so a pointer into it is only
+    good until the next string with an escape in it is read. A pointer into
+    the text of a file is good until the file is edited.
+*/
+const char* get_slice_text(tok_slice_t slice) {
+
+    if(slice.file_id == SLICE_SIDE_BUFFER)
+        return get_char_buffer(scanner->string_buffer) + slice.offset;
+    else if(slice.file_id >= 0 && slice.file_id < get_num_sources() &&
+                get_source(slice.file_id)->buffer != NULL)
+        return source_at(get_source(slice.file_id), slice.offset);
+    return "";
 }
@@ -2,103 +2,146 @@
 #ifndef __LOCAL_H__
 #define __LOCAL_H__
 
-typedef struct __file_stack {
+/*
+    A source is the text of a file that has been opened by the scanner. Sources
+    are kept until the scanner is destroyed, so token slices that point into
+    them stay valid after the file has been closed.
+*/
+typedef struct {
     char* fname;
-    FILE* fp;
-    int line_no;
-    int col_no;
+    char* buffer;   // the whole file, mapped or read
+    size_t length;  // number of bytes in the buffer
+    int mapped;     // buffer came from mmap()
+    int fd;         // being read as it's scanned, or -1, see read_stream()
+    size_t capacity; // of a buffer that was allocated
+    size_t gap_start; // where an edit left a gap in the buffer, see edit_source()
+    size_t gap_len;
+    size_t* lines;  // offsets where each line starts, built on demand
+    size_t nlines;
+    size_t lines_cap;
+    size_t line_scan; // offset that the line table is complete up to
+} source_t;
+
+typedef struct __file_stack {
+    source_t* src;
+    int file_id;    // index of the source in the source list
+    const char* buffer; // copied from the source for get_char()
+    size_t length;
+    size_t index;   // read cursor into the buffer
+    token_info_t* stash; // tokens read ahead in the file under this one
+    int nstash;
+    int stash_flag; // the file under this one had ended
+    char* copy;     // text of an edited source in one piece, or NULL
+    token_block_t* block; // tokens scanned ahead of time, or NULL
+    int block_pos;  // next token in the block
     struct __file_stack* next;
 } file_stack_t;
 
 typedef struct {
     const char* str;
+    size_t len;
     token_t tok;
 } token_map_t;
 
-#ifdef SCANNER_ROOT
-int nest_depth = 0;
-file_stack_t* top = NULL;
-char_buffer_t scanner_buffer;
-int file_flag = 0;
-int last_col;
-
 /*
-    this data structure must be in sorted order.
-    To update, see the file keywordlist.txt in ./tests
-    1. Add the keywords with the token.
-    2. cat keywordlist.txt | sort
-    3. copy/paste the result here.
+    Everything a scanner knows. The scanner functions work on the scanner that
+    is bound to the calling thread (see bind_scanner()), so each thread can
+    scan its own files at the same time as the others.
 */
-token_map_t token_map[] = {
-    {"and", AND_TOKEN},
-    {"as", AS_TOKEN},
-    {"bool", BOOL_TOKEN},
-    {"break", BREAK_TOKEN},
-    {"case", CASE_TOKEN},
-    {"class", CLASS_TOKEN},
-    {"constructor", CONSTRUCTOR_TOKEN},
-    {"continue", CONTINUE_TOKEN},
-    {"create", CREATE_TOKEN},
-    {"default", DEFAULT_TOKEN},
-    {"destroy", DESTROY_TOKEN},
-    {"destructor", DESTRUCTOR_TOKEN},
-    {"dict", DICT_TOKEN},
-    {"do", DO_TOKEN},
-    {"else", ELSE_TOKEN},
-    {"entry", ENTRY_TOKEN},
-    {"equ", EQUALITY_TOKEN},
-    {"except", EXCEPT_TOKEN},
-    {"false", FALSE_TOKEN},
-    {"float", FLOAT_TOKEN},
-    {"for", FOR_TOKEN},
-    {"gte", GTE_TOKEN},
-    {"gt", GT_TOKEN},
-    {"if", IF_TOKEN},
-    {"import", IMPORT_TOKEN},
-    {"inline", INLINE_TOKEN},
-    {"int", INT_TOKEN},
-    {"list", LIST_TOKEN},
-    {"lte", LTE_TOKEN},
-    {"lt", LT_TOKEN},
-    {"map", MAP_TOKEN},
-    {"namespace", NAMESPACE_TOKEN},
-    {"neq", NEQ_TOKEN},
-    {"not", NOT_TOKEN},
-    {"or", OR_TOKEN},
-    {"private", PRIVATE_TOKEN},
-    {"protected", PROTECTED_TOKEN},
-    {"public", PUBLIC_TOKEN},
-    {"raise", RAISE_TOKEN},
-    {"return", RETURN_TOKEN},
-    {"string", STRING_TOKEN},
-    {"super", SUPER_TOKEN},
-    {"switch", SWITCH_TOKEN},
-    {"true", TRUE_TOKEN},
-    {"try", TRY_TOKEN},
-    {"uint", UINT_TOKEN},
-    {"void", VOID_TOKEN},
-    {"while", WHILE_TOKEN},
+struct __scanner {
+    int nest_depth;
+    file_stack_t* top;
+    char_buffer_t scanner_buffer;
+    char_buffer_t string_buffer;
+    int file_flag;
+    tok_slice_t tok_slice;
+    token_info_t cur_tok;
+    int tok_str_ready;
+    int scanning;
+    size_t num_start;   // where the number being read starts
+    tok_value_t num_value; // value of the number being read
+    uint32_t tok_id;    // interned id of the last symbol read
+    hashtable_t* scanned; // token blocks for files scanned ahead of time
+
+    // see tokens.c
+    token_info_t ring[TOKEN_RING_SIZE];
+    uint64_t ring_next;
+    uint64_t ring_end;
 };
 
-const size_t token_map_size = (sizeof(token_map)/sizeof(token_map_t));
+extern __thread scanner_t* scanner;
 
-#else
-extern int nest_depth;
-extern file_stack_t* top;
-extern char_buffer_t scanner_buffer;
-extern int file_flag;
-extern int last_col;
-extern token_map_t token_map[];
-extern const size_t token_map_size;
-#endif
+// A stream is read in blocks of this size as the scanner needs more of it.
+#define STREAM_BLOCK        (0x01 << 18)
+
+// Room that is left for edits when the buffer of a source grows.
+#define EDIT_GAP            (0x01 << 12)
+
+/*
+    The sources are shared by all of the scanners, so a file id means the same
+    thing in every thread. They are kept in chunks that never move, so reading
+    a source does not need the lock that adding one does.
+*/
+#define SOURCE_CHUNK        (256)
+#define MAX_SOURCE_CHUNKS   (4096)
+
+extern source_t** source_chunks[MAX_SOURCE_CHUNKS];
+
+static inline source_t* get_source(int file_id) {
+
+    return source_chunks[file_id / SOURCE_CHUNK][file_id % SOURCE_CHUNK];
+}
+
+// Pointer to the text of the source at the offset. An edit leaves a gap in
+// the buffer of a source at the start of a token (see edit_source()), so the
+// text of a token is in one piece on one side of it.
+static inline const char* source_at(const source_t* src, size_t offset) {
+
+    return (offset < src->gap_start)? &src->buffer[offset]: &src->buffer[offset + src->gap_len];
+}
+
+// defined in chars.c
+#define CC_SPACE        (0x01)
+#define CC_DIGIT        (0x02)
+#define CC_OCTAL        (0x04)
+#define CC_HEX          (0x08)
+#define CC_IDENT_START  (0x10)
+#define CC_IDENT        (0x20)
+#define CC_OPER         (0x40)
+#define CC_QUOTE        (0x80)
+
+extern const unsigned char char_class[256];
+#define IS_CLASS(ch, cls)   (char_class[(unsigned char)(ch)] & (cls))
+
+// defined in cache.c
+// Change this when the scanner or the token numbers change, so that old
+// token cache files are not used.
+#define GTOK_VERSION    (4)
+token_block_t* cached_tokens(const char* fname);
 
 // defined in interface.c (see ../include/scanner.h)
+token_t find_keyword(const char* str, size_t len);
+void push_file(const char* fname, token_block_t* block);
+void push_source(int file_id, token_block_t* block);
+void push_source_from(int file_id, size_t offset);
+token_t scan_token(token_info_t* info);
+void clear_tok_info(token_info_t* info);
 
 // defined in numbers.c
 token_t read_number_top();
 
 // defined in scanner.c
+int load_source(const char* fname);
+int load_stream(int fd, const char* name);
+void edit_source(int file_id, size_t start, size_t end, const char* text, size_t len);
+char* join_source(const source_t* src);
+const char* source_from(source_t* src, size_t offset);
+void free_sources();
+int get_num_sources();
 void close_file();
+void close_ended_files();
+void locate_offset(source_t* src, size_t offset, int* line, int* col);
+void set_tok_slice(size_t start);
 int get_char();
 void unget_char(int ch);
 void skip_ws();
@@ -106,6 +149,36 @@ void eat_until_ws();
 void eat_single_line();
 void eat_multi_line();
 
+// defined in skip.c
+size_t skip_blanks(const char* buf, size_t pos, size_t len);
+size_t find_line_end(const char* buf, size_t pos, size_t len);
+size_t find_comment_end(const char* buf, size_t pos, size_t len);
+size_t find_string_stop(const char* buf, size_t pos, size_t len, int quote);
+size_t skip_blanks_scalar(const char* buf, size_t pos, size_t len);
+size_t find_line_end_scalar(const char* buf, size_t pos, size_t len);
+size_t find_comment_end_scalar(const char* buf, size_t pos, size_t len);
+size_t find_string_stop_scalar(const char* buf, size_t pos, size_t len, int quote);
+
+// defined in tokens.c
+int stash_tokens(token_info_t** arr);
+void restore_tokens(token_info_t* arr, int count);
+int have_tok();
+token_t replay_token(token_info_t* info);
+void splice_block(token_block_t* block, int pos, int del, token_block_t* ins, uint32_t shift);
+
+// Index in the arrays of a block of token i, see splice_block().
+static inline int block_slot(const token_block_t* block, int i) {
+
+    return (i < block->gap_pos)? i: i + block->gap_len;
+}
+
+// Where token i of a block starts in its file.
+static inline uint32_t block_start(const token_block_t* block, int i) {
+
+    int k = block_slot(block, i);
+    return (i < block->gap_pos || block->file_id[k] < 0)? block->start[k]: block->start[k] + block->shift;
+}
+
 // defined in strings.c
 token_t read_dquote();
 token_t read_squote();
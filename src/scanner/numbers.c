@@ -1,139 +1,271 @@
+/*
+    Numbers
+
+    The value of a number is worked out while its digits are read and is kept
+    in the scanner until the token is finished, see get_tok_value(). Integers
+    that do not fit are reported here, so nothing after the scanner has to
+    convert the text again.
+
+    Floats are converted with Clinger's fast path when the digits and the
+    power of ten are both exact in a double, which is most of the floats in a
+    real program. Anything else goes to strtod(), which rounds correctly.
+*/
 #include "common.h"
+#include <float.h>
+#include <math.h>
+
 #include "scanner.h"
 #include "local.h"
 
+// more significant digits than this may not fit in the mantissa
+#define MAX_DEC_DIGITS  (19)
+#define MAX_EXPONENT    (100000)
 
-static token_t read_hex_number() {
+// Powers of ten that are exact in a double.
+static const double exact_pow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+#define MAX_EXACT_POW10 ((int)(sizeof(exact_pow10) / sizeof(exact_pow10[0])) - 1)
+
+// The digits of a decimal number read so far.
+typedef struct {
+    uint64_t mant;  // the significant digits
+    int digits;     // number of significant digits in the mantissa
+    int inexact;    // non-zero digits were left out of the mantissa
+    int exp10;      // power of ten that the mantissa is multiplied by
+} decimal_t;
+
+
+// The text of the number is still in the source, so print it from there.
+static token_t malformed(const char* kind) {
+
+    syntax("malformed %s number: %.*s", kind, (int)(scanner->top->index - scanner->num_start),
+                &scanner->top->buffer[scanner->num_start]);
+    return ERROR_TOKEN;
+}
+
+static token_t too_large(const char* kind) {
+
+    syntax("%s number is too large: %.*s", kind, (int)(scanner->top->index - scanner->num_start),
+                &scanner->top->buffer[scanner->num_start]);
+    return ERROR_TOKEN;
+}
+
+// eat the rest of the digits of a malformed number
+static void eat_digits() {
 
     int ch;
-    while(isxdigit(ch = get_char()))
-        add_char_buffer(scanner_buffer, ch);
+    while(IS_CLASS(ch = get_char(), CC_DIGIT))
+        ;
+    unget_char(ch);
+}
+
+static inline int hex_value(int ch) {
+
+    return IS_CLASS(ch, CC_DIGIT)? ch - '0': (ch | 0x20) - 'a' + 10;
+}
+
+// Add a digit that is left of the decimal point.
+static inline void add_int_digit(decimal_t* dec, int ch) {
+
+    if(dec->digits < MAX_DEC_DIGITS) {
+        dec->mant = dec->mant * 10 + (ch - '0');
+        if(dec->mant != 0)
+            dec->digits++;
+    }
+    else {
+        dec->exp10++;
+        if(ch != '0')
+            dec->inexact = 1;
+    }
+}
+
+// Add a digit that is right of the decimal point.
+static inline void add_frac_digit(decimal_t* dec, int ch) {
+
+    if(dec->digits < MAX_DEC_DIGITS) {
+        dec->mant = dec->mant * 10 + (ch - '0');
+        if(dec->mant != 0)
+            dec->digits++;
+        dec->exp10--;
+    }
+    else if(ch != '0')
+        dec->inexact = 1;
+}
+
+// Convert the text of the float with strtod(), which needs it terminated.
+static double slow_float(const char* str, size_t len) {
+
+    char tbuf[64];
+    char* buf = (len < sizeof(tbuf))? tbuf: MALLOC(len + 1);
+
+    memcpy(buf, str, len);
+    buf[len] = '\0';
+    errno = 0;
+    double val = strtod(buf, NULL);
+    if(errno == ERANGE && isinf(val))
+        val = HUGE_VAL;     // underflow, to zero or a subnormal, is left as the nearest value
+
+    if(buf != tbuf)
+        FREE(buf);
+    return val;
+}
+
+static token_t finish_float(decimal_t* dec) {
+
+    double val;
 
+    if(dec->mant == 0)
+        val = 0.0;
+    else if(!dec->inexact && dec->mant <= (0x01ull << DBL_MANT_DIG) &&
+                dec->exp10 >= -MAX_EXACT_POW10 && dec->exp10 <= MAX_EXACT_POW10) {
+        // both are exact, so one rounding gives the right answer
+        val = (double)dec->mant;
+        if(dec->exp10 < 0)
+            val /= exact_pow10[-dec->exp10];
+        else
+            val *= exact_pow10[dec->exp10];
+    }
+    else
+        val = slow_float(&scanner->top->buffer[scanner->num_start],
+                            scanner->top->index - scanner->num_start);
+
+    if(val == HUGE_VAL)
+        return too_large("float");
+
+    scanner->num_value.float_val = val;
+    return FNUM_TOKEN;
+}
+
+static token_t read_hex_number() {
+
+    int ch, over = 0;
+    uint64_t val = 0;
+
+    while(IS_CLASS(ch = get_char(), CC_HEX)) {
+        if(val >> 60)
+            over++;
+        val = (val << 4) | hex_value(ch);
+    }
+    unget_char(ch);
+
+    if(over)
+        return too_large("hex");
+    scanner->num_value.uint_val = val;
     return UNUM_TOKEN;
 }
 
-static token_t read_octal_number() {
+// The first digit has been read and is passed in.
+static token_t read_octal_number(int ch) {
 
-    int ch;
-    while(isdigit(ch = get_char())) {
-        if(ch <= '7')
-            add_char_buffer(scanner_buffer, ch);
-        else {
+    int over = 0;
+    uint64_t val = ch - '0';
+
+    while(IS_CLASS(ch = get_char(), CC_DIGIT)) {
+        if(ch > '7') {
             // eat the rest of the number and publish an error
-            while(isdigit(ch = get_char()))
-                add_char_buffer(scanner_buffer, ch);
-            unget_char(ch);
-            syntax("malformed octal number: %s", get_char_buffer(scanner_buffer));
-            return ERROR_TOKEN;
+            eat_digits();
+            return malformed("octal");
         }
+        if(val >> 61)
+            over++;
+        val = (val << 3) | (ch - '0');
     }
+    unget_char(ch);
+
+    if(over)
+        return too_large("octal");
+    scanner->num_value.uint_val = val;
     return ONUM_TOKEN;
 }
 
-// we can only enter here <after> we have seen a '.'
-static token_t read_float_number() {
+// we can only enter here <after> we have seen a '.'. The digits before it
+// are passed in.
+static token_t read_float_number(decimal_t* dec) {
 
     int ch;
-    while(isdigit(ch = get_char())) {
-        add_char_buffer(scanner_buffer, ch);
-    }
+    while(IS_CLASS(ch = get_char(), CC_DIGIT))
+        add_frac_digit(dec, ch);
 
     // see if we are reading a mantisa
     if(ch == 'e' || ch == 'E') {
-        add_char_buffer(scanner_buffer, ch);
+        int neg = 0, exp = 0;
         ch = get_char();
         if(ch == '+' || ch == '-') {
-            add_char_buffer(scanner_buffer, ch);
+            neg = (ch == '-');
             ch = get_char();
-            if(isdigit(ch)) {
-                add_char_buffer(scanner_buffer, ch);
-            }
-            else {
-                unget_char(ch);
-                syntax("malformed float number: %s", get_char_buffer(scanner_buffer));
-                return ERROR_TOKEN;
-            }
-            while(isdigit(ch = get_char())) {
-                add_char_buffer(scanner_buffer, ch);
-            }
-            unget_char(ch);
         }
-        else if(isdigit(ch)) {
-            add_char_buffer(scanner_buffer, ch);
-            while(isdigit(ch = get_char())) {
-                add_char_buffer(scanner_buffer, ch);
-            }
-        }
-        else {
+        if(!IS_CLASS(ch, CC_DIGIT)) {
             // eat the rest of the number and publish an error
-            while(isdigit(ch = get_char()))
-                add_char_buffer(scanner_buffer, ch);
             unget_char(ch);
-            syntax("malformed float number: %s", get_char_buffer(scanner_buffer));
-            return ERROR_TOKEN;
+            eat_digits();
+            return malformed("float");
+        }
+        for(; IS_CLASS(ch, CC_DIGIT); ch = get_char()) {
+            if(exp < MAX_EXPONENT)
+                exp = exp * 10 + (ch - '0');
         }
+        unget_char(ch);
+        dec->exp10 += neg? -exp: exp;
     }
     else
         unget_char(ch);
 
-    return FNUM_TOKEN;
+    return finish_float(dec);
 }
 
 // When this is seen, we have a number. The character is passed as a
-// parameter. could be a hex, decimal, or a float.
+// parameter. could be a hex, decimal, or a float. The text of the number is
+// left in the source, get_tok() makes the slice.
 token_t read_number_top() {
 
+    decimal_t dec = {0, 0, 0, 0};
+
+    scanner->num_start = scanner->top->index;
     int ch = get_char();
 
     // first char is always a digit
     if(ch == '0') { // could be hex, octal, decimal, or float
-        add_char_buffer(scanner_buffer, ch);
         ch = get_char();
         if(ch == 'x' || ch == 'X') {
-            add_char_buffer(scanner_buffer, ch);
             return read_hex_number();
         }
         else if(ch == '.') {
-            add_char_buffer(scanner_buffer, ch);
-            return read_float_number();
+            return read_float_number(&dec);
         }
-        else if(isdigit(ch)) { // is an octal number
+        else if(IS_CLASS(ch, CC_DIGIT)) { // is an octal number
             if(ch <= '7') {
-                add_char_buffer(scanner_buffer, ch);
-                return read_octal_number();
+                return read_octal_number(ch);
             }
             else {
                 // it's a malformed number. eat the rest of it and post an error
-                while(isdigit(ch = get_char()))
-                    add_char_buffer(scanner_buffer, ch);
-                unget_char(ch);
-                syntax("malformed octal number: %s", get_char_buffer(scanner_buffer));
-                return ERROR_TOKEN;
+                eat_digits();
+                return malformed("octal");
             }
         }
         else { // it's just a zero
             unget_char(ch);
+            scanner->num_value.int_val = 0;
             return INUM_TOKEN;
         }
     }
     else { // It's either a dec or a float.
-        int finished = 0;
-        add_char_buffer(scanner_buffer, ch);
-        while(!finished) {
-            ch = get_char();
-            if(isdigit(ch))
-                add_char_buffer(scanner_buffer, ch);
-            else if(ch == '.') {
-                add_char_buffer(scanner_buffer, ch);
-                return read_float_number();
-            }
-            else {
-                finished++;
-                unget_char(ch);
-                return INUM_TOKEN;
-            }
+        uint64_t val = 0;
+        int over = 0;
+        for(; IS_CLASS(ch, CC_DIGIT); ch = get_char()) {
+            add_int_digit(&dec, ch);
+            if(val > (INT64_MAX - (ch - '0')) / 10)
+                over++;
+            val = val * 10 + (ch - '0');
         }
+        if(ch == '.')
+            return read_float_number(&dec);
+
+        unget_char(ch);
+        if(over)
+            return too_large("decimal");
+        scanner->num_value.int_val = (int64_t)val;
+        return INUM_TOKEN;
     }
-    // If we reach here, then some syntax that is not covered has been submitted
-    return ERROR_TOKEN;
 }
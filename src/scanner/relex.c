@@ -0,0 +1,169 @@
+/*
+    Incremental scanning
+
+    When a file that has been scanned into a block is edited, relex_tokens()
+    scans again only the part of it that could have changed. Scanning starts
+    at the token before the one that touches the edit, so a token that runs
+    into the edited text is scanned again with it. A token never starts inside
+    of a string or a comment, so the start of any token is a safe place to
+    start scanning.
+
+    Scanning stops at the first new token after the edit that is the same as
+    an old one, moved by the size of the edit. The text from there on is the
+    same as it was, so the rest of the old tokens are kept and only their
+    offsets are moved. The scanning that is done depends on the size of the
+    edit, not on the size of the file.
+
+    The rest of the work does not depend on the size of the file either. The
+    source and the arrays of the block keep a gap where they were last edited
+    (see edit_source() and splice_block()), so only what is between two edits
+    is moved. The tokens after the edit keep their old offsets, with a shift
+    for all of them that is added as they are read. Reading the tokens or the
+    text of the file does not close the gaps, so reading them does not undo
+    this. Only settle_block() and scanning the whole file again do, and those
+    cost as much as the file anyway. The side text of the tokens that are
+    replaced is reclaimed when it is more than half of the side text of the
+    block.
+*/
+#include "common.h"
+#include "scanner.h"
+#include "local.h"
+
+// Index of the END_OF_FILE token of the file, which is at the end.
+static int find_file_end(token_block_t* block, int file_id) {
+
+    for(int i = block->count - 1; i >= 0; i--) {
+        int k = block_slot(block, i);
+        if(block->tok[k] == END_OF_FILE && block->file_id[k] == file_id)
+            return i;
+    }
+
+    fatal_error("token block has no end of file");
+    return -1;
+}
+
+// Index of the first token before the end that ends at or after the offset.
+static int find_token(token_block_t* block, int end, size_t offset) {
+
+    int lo = 0, hi = end;
+    while(lo < hi) {
+        int mid = (lo + hi) / 2;
+        if(block_start(block, mid) + block->length[block_slot(block, mid)] < offset)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// Bytes of side text that the tokens from first up to end use.
+static size_t side_used(token_block_t* block, int first, int end) {
+
+    size_t used = 0;
+    for(int i = first; i < end; i++) {
+        int k = block_slot(block, i);
+        if(block->side[k] != BLOCK_NO_SIDE)
+            used += block->side_length[k] + 1;
+    }
+    return used;
+}
+
+// Copy the side text that is still used to a new buffer.
+static void compact_side(token_block_t* block) {
+
+    size_t len = side_used(block, 0, block->count);
+    char* text = MALLOC(len + 1);
+
+    len = 0;
+    for(int i = 0; i < block->count; i++) {
+        int k = block_slot(block, i);
+        if(block->side[k] != BLOCK_NO_SIDE) {
+            memcpy(&text[len], &block->side_text[block->side[k]], block->side_length[k] + 1);
+            block->side[k] = (uint32_t)len;
+            len += block->side_length[k] + 1;
+        }
+    }
+    text[len] = '\0';
+
+    FREE(block->side_text);
+    block->side_text = text;
+    block->side_len = len;
+    block->side_dead = 0;
+}
+
+/*
+    The bytes of the file from start to end have been replaced with the text
+    given. Change the source and the tokens of the file in the block to match.
+    The block must hold the tokens of one file, as made by scan_tokens(), and
+    have its own copy of the side text (see keep_block_text()). Returns the
+    number of tokens that were scanned.
+
+    The file must not be open in another scanner while this is done.
+*/
+int relex_tokens(token_block_t* block, size_t start, size_t end, const char* text, size_t len) {
+
+    int file_id = block->file_id[block_slot(block, 0)];
+    int eof = find_file_end(block, file_id);
+    ssize_t delta = (ssize_t)len - (ssize_t)(end - start);
+
+    int first = find_token(block, eof, start);
+    if(first > 0)
+        first--;
+    size_t from = (first > 0)? block_start(block, first): 0;
+
+    edit_source(file_id, start, end, text, len);
+
+    // scan with a scanner of its own, so the one in use is not disturbed
+    scanner_t* prev = bind_scanner(create_scanner());
+    push_source_from(file_id, from);
+
+    token_block_t* ins = create_token_block(TOKEN_BATCH);
+    int old = first;
+    while(1) {
+        scan_tokens(ins, 1);
+        int i = ins->count - 1;
+        if(ins->tok[i] == END_OF_FILE) {
+            old = eof + 1;
+            break;
+        }
+
+        if(ins->start[i] >= start + len) {
+            // past the edit, so look for the same token in the old block
+            size_t pos = ins->start[i] - delta;
+            while(old < eof && block_start(block, old) < pos)
+                old++;
+            int k = block_slot(block, old);
+            if(old < eof && block_start(block, old) == pos && block->tok[k] == ins->tok[i] &&
+                        block->length[k] == ins->length[i]) {
+                ins->count--;
+                break;
+            }
+        }
+    }
+
+    int count = ins->count;
+    block->side_dead += side_used(block, first, old);
+    splice_block(block, first, old - first, ins, (uint32_t)delta);
+
+    // strings with escapes are in the side buffer of the scanner that was used
+    size_t side_len = get_char_buffer_len(scanner->string_buffer);
+    if(side_len > 0) {
+        block->side_text = REALLOC(block->side_text, block->side_len + side_len + 1);
+        memcpy(&block->side_text[block->side_len], get_char_buffer(scanner->string_buffer), side_len);
+        // the tokens put in are before the gap, so they are where they look
+        for(int i = first; i < first + count; i++)
+            if(block->side[i] != BLOCK_NO_SIDE)
+                block->side[i] += block->side_len;
+        block->side_len += side_len;
+        block->side_text[block->side_len] = '\0';
+        block->side_dead += side_len - side_used(block, first, first + count);
+    }
+
+    if(block->side_dead > block->side_len / 2)
+        compact_side(block);
+
+    destroy_token_block(ins);
+    destroy_scanner(get_scanner());
+    bind_scanner(prev);
+    return count;
+}
@@ -4,48 +4,328 @@
     This module separates the input text into tokens and then returns the token.
 */
 #include "common.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <pthread.h>
 
 #include "scanner.h"
 #include "char_buffer.h"
-#define SCANNER_ROOT
 #include "local.h"
 
+__thread scanner_t* scanner = NULL;
+
+source_t** source_chunks[MAX_SOURCE_CHUNKS];
+static int num_sources = 0;
+static pthread_mutex_t sources_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+    Read the whole file into memory. Regular files are mapped, anything else
+    (pipes, character devices) is read into an allocated buffer. An empty file
+    leaves the buffer NULL with a length of zero.
+*/
+static void read_file(source_t* src, const char* fname) {
+
+    struct stat st;
+    int fd = open(fname, O_RDONLY);
+    if(fd < 0)
+        fatal_error("Cannot open input file: \"%s\": %s", fname, strerror(errno));
+
+    if(fstat(fd, &st) < 0)
+        fatal_error("Cannot stat input file: \"%s\": %s", fname, strerror(errno));
+
+    src->buffer = NULL;
+    src->length = 0;
+    src->mapped = 0;
+
+    if(S_ISREG(st.st_mode)) {
+        if(st.st_size > 0) {
+            void* ptr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(ptr != MAP_FAILED) {
+                madvise(ptr, st.st_size, MADV_SEQUENTIAL);
+                src->buffer = (char*)ptr;
+                src->length = st.st_size;
+                src->mapped = 1;
+                close(fd);
+                return;
+            }
+        }
+        else {
+            close(fd);
+            return;
+        }
+    }
+
+    // not mappable, read it in large chunks
+    size_t capacity = 0x01 << 16;
+    src->buffer = MALLOC(capacity);
+    while(1) {
+        if(src->length == capacity) {
+            capacity = capacity << 1;
+            src->buffer = REALLOC(src->buffer, capacity);
+        }
+        ssize_t len = read(fd, &src->buffer[src->length], capacity - src->length);
+        if(len < 0) {
+            if(errno == EINTR)
+                continue;
+            fatal_error("Cannot read input file: \"%s\": %s", fname, strerror(errno));
+        }
+        else if(len == 0)
+            break;
+        src->length += len;
+    }
+    src->capacity = capacity;
+    close(fd);
+}
+
+// Add the source to the list and return its file id.
+static int add_source(source_t* src) {
+
+    int file_id;
+
+    pthread_mutex_lock(&sources_lock);
+    file_id = num_sources;
+    if(file_id / SOURCE_CHUNK >= MAX_SOURCE_CHUNKS)
+        fatal_error("too many source files: %d", file_id);
+
+    if(source_chunks[file_id / SOURCE_CHUNK] == NULL)
+        source_chunks[file_id / SOURCE_CHUNK] = CALLOC(SOURCE_CHUNK, sizeof(source_t*));
+    source_chunks[file_id / SOURCE_CHUNK][file_id % SOURCE_CHUNK] = src;
+    __atomic_store_n(&num_sources, file_id + 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&sources_lock);
+
+    return file_id;
+}
+
+/*
+    Load a file into the source list and return its file id. The file is read
+    before the lock is taken, so threads only wait on each other to add the
+    source to the list.
+*/
+int load_source(const char* fname) {
+
+    source_t* src = (source_t*)CALLOC(1, sizeof(source_t));
+    read_file(src, fname);
+    src->fname = STRDUP(fname);
+    src->fd = -1;
+    return add_source(src);
+}
+
+/*
+    Add a source that is read from the file descriptor as it's scanned,
+    instead of all at once. This is for pipes, where the scanner can start
+    before the writer is done. The text is kept in one buffer that grows, so
+    a token can run across the blocks that are read and slices stay good. A
+    pointer into the buffer is only good until more is read.
+*/
+int load_stream(int fd, const char* name) {
+
+    source_t* src = (source_t*)CALLOC(1, sizeof(source_t));
+    src->fname = STRDUP(name);
+    src->fd = fd;
+    return add_source(src);
+}
+
+/*
+    Read the next block of a stream. Returns the number of bytes read, which
+    is zero at the end. The file descriptor is closed at the end, except for
+    the standard input.
+*/
+static size_t read_stream(source_t* src) {
+
+    ssize_t len;
+
+    if(src->fd < 0)
+        return 0;
+
+    if(src->length + STREAM_BLOCK > src->capacity) {
+        while(src->length + STREAM_BLOCK > src->capacity)
+            src->capacity = (src->capacity == 0)? STREAM_BLOCK: src->capacity << 1;
+        src->buffer = REALLOC(src->buffer, src->capacity);
+    }
+
+    do {
+        len = read(src->fd, &src->buffer[src->length], STREAM_BLOCK);
+    } while(len < 0 && errno == EINTR);
+
+    if(len < 0)
+        fatal_error("Cannot read input file: \"%s\": %s", src->fname, strerror(errno));
+    else if(len == 0) {
+        if(src->fd != STDIN_FILENO)
+            close(src->fd);
+        src->fd = -1;
+    }
+    src->length += len;
+    return len;
+}
+
+/*
+    Read more of the file if it's a stream. Returns non-zero if there is more
+    to scan.
+*/
+static int more_input(file_stack_t* fsp) {
+
+    if(fsp->src->fd < 0 || read_stream(fsp->src) == 0)
+        return 0;
+
+    fsp->buffer = fsp->src->buffer;
+    fsp->length = fsp->src->length;
+    return 1;
+}
+
+int get_num_sources() {
+
+    return __atomic_load_n(&num_sources, __ATOMIC_ACQUIRE);
+}
+
+// Called at exit, after all of the scanners are done with the sources.
+void free_sources() {
+
+    for(int i = 0; i < num_sources; i++) {
+        source_t* src = get_source(i);
+        FREE(src->fname);
+        if(src->fd > STDIN_FILENO)
+            close(src->fd);
+        if(src->lines != NULL)
+            FREE(src->lines);
+        if(src->mapped)
+            munmap(src->buffer, src->length);
+        else if(src->buffer != NULL)
+            FREE(src->buffer);
+        FREE(src);
+    }
+
+    for(int i = 0; i < MAX_SOURCE_CHUNKS && source_chunks[i] != NULL; i++) {
+        FREE(source_chunks[i]);
+        source_chunks[i] = NULL;
+    }
+    num_sources = 0;
+}
+
+/*
+    A source that has been edited keeps a gap in its buffer where it was last
+    changed, so an edit only moves the text between it and the one before.
+    The text after the gap is gap_len bytes further on in the buffer. A source
+    with no gap has a gap_len of zero.
+*/
+static void move_gap(source_t* src, size_t pos) {
+
+    if(src->gap_len > 0) {
+        if(pos < src->gap_start)
+            memmove(&src->buffer[pos + src->gap_len], &src->buffer[pos], src->gap_start - pos);
+        else
+            memmove(&src->buffer[src->gap_start],
+                        &src->buffer[src->gap_start + src->gap_len], pos - src->gap_start);
+    }
+    src->gap_start = pos;
+}
+
+// Make the gap at least as big as the size given. It grows by an eighth of
+// the text as well, so that a run of edits does not copy the file each time.
+static void grow_gap(source_t* src, size_t size) {
+
+    size_t tail = src->capacity - src->gap_start - src->gap_len;
+    size_t capacity = src->gap_start + tail + size + (src->length >> 3) + EDIT_GAP;
+
+    src->buffer = REALLOC(src->buffer, capacity);
+    memmove(&src->buffer[capacity - tail], &src->buffer[src->capacity - tail], tail);
+    src->gap_len = capacity - src->gap_start - tail;
+    src->capacity = capacity;
+}
+
+/*
+    Replace the bytes from start to end of the source with the text given.
+    This is for a file that is being edited, see relex.c. Scanners that have
+    the source open must not be reading it while it changes. The text is left
+    with the gap after the new text, and relex_tokens() then moves it to the
+    start of a token. The line table is kept up to the start of the edit.
+*/
+void edit_source(int file_id, size_t start, size_t end, const char* text, size_t len) {
+
+    source_t* src = get_source(file_id);
+
+    if(src->mapped) {
+        // a mapped file cannot be changed, so it becomes a copy
+        char* buf = MALLOC(src->length + EDIT_GAP);
+        memcpy(buf, src->buffer, src->length);
+        munmap(src->buffer, src->length);
+        src->buffer = buf;
+        src->capacity = src->length + EDIT_GAP;
+        src->mapped = 0;
+        src->gap_len = 0;
+    }
+
+    if(src->gap_len == 0) {
+        // the spare room at the end of the buffer is the gap
+        src->gap_start = src->length;
+        src->gap_len = src->capacity - src->length;
+    }
+
+    // the text that is replaced becomes part of the gap
+    move_gap(src, start);
+    src->gap_len += end - start;
+    if(src->gap_len < len)
+        grow_gap(src, len);
 
+    memcpy(&src->buffer[start], text, len);
+    src->gap_start += len;
+    src->gap_len -= len;
+    src->length = src->length - (end - start) + len;
+
+    if(src->lines != NULL) {
+        while(src->nlines > 1 && src->lines[src->nlines - 1] > start)
+            src->nlines--;
+        if(src->line_scan > start)
+            src->line_scan = start;
+    }
+}
+
+// The source stays in the source list. Only the read cursor goes away. Tokens
+// that were set aside when the file was opened go back into the token ring.
 void close_file() {
 
-    if(top != NULL) {
-        file_stack_t* fsp = top;
-        top = top->next; // could make top NULL
-        FREE(fsp->fname);
-        fclose(fsp->fp);
+    if(scanner->top != NULL) {
+        file_stack_t* fsp = scanner->top;
+        scanner->top = scanner->top->next; // could make top NULL
+        scanner->nest_depth--;
+        if(fsp->block != NULL)
+            destroy_token_block(fsp->block);
+        if(fsp->copy != NULL)
+            FREE(fsp->copy);
+        if(fsp->stash != NULL) {
+            restore_tokens(fsp->stash, fsp->nstash);
+            FREE(fsp->stash);
+        }
+        scanner->file_flag = fsp->stash_flag;
         FREE(fsp);
     }
 }
 
+// Closing a file is deferred until after the END_OF_FILE token has been read.
+// Closing a file can bring back a deferred close of the one under it.
+void close_ended_files() {
+
+    while(scanner->file_flag) {
+        scanner->file_flag = 0;
+        close_file();
+    }
+}
+
 int get_char() {
 
     int ch;
 
-    // defer closing the file until after the END_OF_FILE token has been read.
-    if(file_flag) {
-        file_flag = 0;
-        close_file();
-    }
+    if(scanner->file_flag)
+        close_ended_files();
 
-    if(top != NULL) {
-        ch = fgetc(top->fp);
-        if(ch == EOF) {
+    file_stack_t* fsp = scanner->top;
+    if(fsp != NULL) {
+        if(fsp->index < fsp->length || more_input(fsp))
+            ch = (unsigned char)fsp->buffer[fsp->index++];
+        else
             ch = END_FILE;
-        }
-        else if(ch == '\n') {
-            top->line_no ++;
-            last_col = top->col_no;
-            top->col_no = 1;
-        }
-        else {
-            top->col_no ++;
-            //last_col = top->col_no;
-        }
     }
     else {
         ch = END_INPUT;
@@ -53,35 +333,119 @@ int get_char() {
     return ch;
 }
 
+// Pushing back is just moving the cursor. The end of file is not a character
+// in the buffer, so there is nothing to move over.
 void unget_char(int ch) {
 
-    if(top != NULL) {
-        ungetc(ch, top->fp);
-        if(ch == '\n') {
-            top->line_no--;
-            top->col_no = last_col;
+    file_stack_t* fsp = scanner->top;
+    if(fsp != NULL && ch != END_FILE && fsp->index > 0)
+        fsp->index--;
+}
+
+/*
+    Return a copy of the text of an edited source in one piece, which the
+    caller must free, or NULL if the text is already in one piece. The source
+    is not changed, so scanners in other threads can read it at the same time.
+*/
+char* join_source(const source_t* src) {
+
+    if(src->gap_len == 0 || src->gap_start >= src->length)
+        return NULL;
+
+    char* text = MALLOC(src->length);
+    memcpy(text, src->buffer, src->gap_start);
+    memcpy(&text[src->gap_start], &src->buffer[src->gap_start + src->gap_len],
+                src->length - src->gap_start);
+    return text;
+}
+
+/*
+    Return a pointer that the text of the source from the offset on can be
+    read through with the offset as the index. The gap is moved to the offset,
+    so only the text between the two is moved. See relex.c.
+*/
+const char* source_from(source_t* src, size_t offset) {
+
+    move_gap(src, offset);
+    return src->buffer + src->gap_len;
+}
+
+/*
+    Extend the line start table of the file so that it covers everything up to
+    the offset given. The table is only built when a position is actually asked
+    for, and then only as far as it is needed.
+*/
+static void index_lines(source_t* src, size_t offset) {
+
+    if(src->lines == NULL) {
+        src->lines_cap = 0x01 << 8;
+        src->lines = MALLOC(src->lines_cap * sizeof(size_t));
+        src->lines[0] = 0;
+        src->nlines = 1;
+        src->line_scan = 0;
+    }
+
+    if(offset > src->length)
+        offset = src->length;
+
+    while(src->line_scan < offset) {
+        // the text before the gap and the text after it are searched apart
+        size_t stop = offset, skip = 0;
+        if(src->line_scan >= src->gap_start)
+            skip = src->gap_len;
+        else if(stop > src->gap_start)
+            stop = src->gap_start;
+
+        const char* ptr = memchr(&src->buffer[src->line_scan + skip], '\n', stop - src->line_scan);
+        if(ptr == NULL) {
+            src->line_scan = stop;
+            continue;
         }
-        else {
-            if(top->col_no > 1)
-                top->col_no --;
-            else
-                top->col_no = 1;
+
+        if(src->nlines + 1 > src->lines_cap) {
+            src->lines_cap = src->lines_cap << 1;
+            src->lines = REALLOC(src->lines, src->lines_cap * sizeof(size_t));
         }
+        src->line_scan = (ptr - src->buffer) - skip + 1;
+        src->lines[src->nlines++] = src->line_scan;
+    }
+}
+
+/*
+    Convert a byte offset in the file to a line and column number. Both start
+    at 1. The column is that of the character at the offset.
+*/
+void locate_offset(source_t* src, size_t offset, int* line, int* col) {
+
+    index_lines(src, offset);
+
+    // find the last line that starts at or before the offset
+    size_t start = 0, end = src->nlines;
+    while(end - start > 1) {
+        size_t mid = (start + end) / 2;
+        if(src->lines[mid] <= offset)
+            start = mid;
+        else
+            end = mid;
     }
+
+    if(line != NULL)
+        *line = (int)start + 1;
+    if(col != NULL)
+        *col = (int)(offset - src->lines[start]) + 1;
 }
 
 void skip_ws() {
 
-    int ch, finished = 0;
+    // get_char() takes care of closing a file that has ended.
+    int ch = get_char();
+    unget_char(ch);
 
-    while(!finished) {
-        ch = get_char();
-        if(!isspace(ch)) {
-            unget_char(ch);
-            finished++;
-        }
-        else if(ch == END_INPUT)
-            finished++;
+    file_stack_t* fsp = scanner->top;
+    if(fsp != NULL) {
+        do {
+            fsp->index = skip_blanks(fsp->buffer, fsp->index, fsp->length);
+        } while(fsp->index == fsp->length && more_input(fsp));
     }
     // next char in input stream is not blank.
 }
@@ -90,49 +454,63 @@ void skip_ws() {
 void eat_until_ws() {
 
     int ch;
-    while(!isspace(ch = get_char()))
-        add_char_buffer(scanner_buffer, ch);
+    while(!IS_CLASS(ch = get_char(), CC_SPACE) && ch != END_FILE)
+        ;
     unget_char(ch);
 }
 
-// Eat a single line comment after the initial '/' has been seen.
-void eat_single_line() {
+/*
+    The token text runs from the start offset given to the read cursor of the
+    current file.
+*/
+void set_tok_slice(size_t start) {
+
+    if(scanner->top != NULL) {
+        scanner->tok_slice.file_id = scanner->top->file_id;
+        scanner->tok_slice.offset = start;
+        scanner->tok_slice.length = scanner->top->index - start;
+    }
+    else {
+        scanner->tok_slice.file_id = SLICE_SIDE_BUFFER;
+        scanner->tok_slice.offset = 0;
+        scanner->tok_slice.length = 0;
+    }
+}
 
-    int ch, finished = 0;
+// Eat a single line comment after the initial '/' has been seen. The new line
+// is left in the input.
+void eat_single_line() {
 
-    while(!finished) {
-        ch = get_char();
-        if(ch == '\n' || ch == END_FILE) {
-            //return NONE_TOKEN;
-            unget_char(ch);
-            break;
-        }
+    file_stack_t* fsp = scanner->top;
+    if(fsp != NULL) {
+        do {
+            fsp->index = find_line_end(fsp->buffer, fsp->index, fsp->length);
+        } while(fsp->index == fsp->length && more_input(fsp));
     }
 }
 
-// Eat a multi line comment after the initial '/' has been seen.
+// Eat a multi line comment after the initial '/' has been seen. A comment
+// that is not closed eats the rest of the file.
 void eat_multi_line() {
 
-    int ch, state = 0;
-
-    while(ch != END_OF_INPUT) {
-        ch = get_char();
-        switch(state) {
-            case 0:
-                if(ch == '*')
-                    state = 1;
-                //fprintf(stderr, "0");
-                break;
-            case 1:
-                if(ch == '/')
-                    state = 2;
-                else if(ch != '*')
-                    state = 0;
-                //fprintf(stderr, "1");
-                break;
-            case 2:
-                unget_char(ch);
-                return;
+    file_stack_t* fsp = scanner->top;
+    if(fsp == NULL)
+        return;
+
+    size_t start = fsp->index;
+    while(1) {
+        size_t end = find_comment_end(fsp->buffer, fsp->index, fsp->length);
+        if(end < fsp->length || (end >= start + 2 &&
+                    fsp->buffer[end - 2] == '*' && fsp->buffer[end - 1] == '/')) {
+            fsp->index = end;
+            return;
+        }
+
+        // the "*/" could be split by the end of the block
+        fsp->index = (end > start)? end - 1: start;
+        if(!more_input(fsp)) {
+            fsp->index = fsp->length;
+            return;
         }
     }
 }
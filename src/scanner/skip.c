@@ -0,0 +1,189 @@
+/*
+    Fast skipping
+
+    These routines look for the end of white space and comments in an in-memory
+    source buffer. They look at 16 (SSE2) or 32 (AVX2) bytes at a time and fall
+    back to a plain loop for the tail of the buffer, or when neither is
+    available. AVX2 is only used when the compiler is told that the target has
+    it, such as with -march=native.
+
+    All of them take the buffer, the offset to start at and the length of the
+    buffer, and return an offset. They never look past the length.
+
+    find_string_stop() is used the same way inside of strings, to get past
+    the characters that are copied as they are.
+*/
+#include "common.h"
+
+#include "scanner.h"
+#include "local.h"
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// Same set of characters as isspace() in the "C" locale.
+static inline int is_blank(int ch) {
+
+    return ch == ' ' || (unsigned)(ch - '\t') <= (unsigned)('\r' - '\t');
+}
+
+size_t skip_blanks_scalar(const char* buf, size_t pos, size_t len) {
+
+    while(pos < len && is_blank((unsigned char)buf[pos]))
+        pos++;
+    return pos;
+}
+
+size_t find_line_end_scalar(const char* buf, size_t pos, size_t len) {
+
+    while(pos < len && buf[pos] != '\n')
+        pos++;
+    return pos;
+}
+
+size_t find_comment_end_scalar(const char* buf, size_t pos, size_t len) {
+
+    for(; pos + 1 < len; pos++) {
+        if(buf[pos] == '*' && buf[pos+1] == '/')
+            return pos + 2;
+    }
+    return len;
+}
+
+size_t find_string_stop_scalar(const char* buf, size_t pos, size_t len, int quote) {
+
+    while(pos < len && buf[pos] != quote && buf[pos] != '\\' && buf[pos] != '\n')
+        pos++;
+    return pos;
+}
+
+/*
+    Return the offset of the first character that is not white space, or the
+    length if the rest of the buffer is blank.
+*/
+size_t skip_blanks(const char* buf, size_t pos, size_t len) {
+
+    // most tokens are separated by a single blank
+    if(pos < len && !is_blank((unsigned char)buf[pos]))
+        return pos;
+    if(pos + 1 < len && !is_blank((unsigned char)buf[pos+1]))
+        return pos + 1;
+
+#if defined(__AVX2__)
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i range = _mm256_set1_epi8('\r' - '\t');
+
+    for(; pos + 32 <= len; pos += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)&buf[pos]);
+        __m256i t = _mm256_sub_epi8(v, tab);
+        __m256i blank = _mm256_or_si256(_mm256_cmpeq_epi8(v, space),
+                            _mm256_cmpeq_epi8(_mm256_min_epu8(t, range), t));
+        uint32_t mask = ~(uint32_t)_mm256_movemask_epi8(blank);
+        if(mask != 0)
+            return pos + __builtin_ctz(mask);
+    }
+#elif defined(__SSE2__)
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i range = _mm_set1_epi8('\r' - '\t');
+
+    for(; pos + 16 <= len; pos += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)&buf[pos]);
+        __m128i t = _mm_sub_epi8(v, tab);
+        __m128i blank = _mm_or_si128(_mm_cmpeq_epi8(v, space),
+                            _mm_cmpeq_epi8(_mm_min_epu8(t, range), t));
+        uint32_t mask = ~(uint32_t)_mm_movemask_epi8(blank) & 0xFFFF;
+        if(mask != 0)
+            return pos + __builtin_ctz(mask);
+    }
+#endif
+    return skip_blanks_scalar(buf, pos, len);
+}
+
+/*
+    Return the offset of the next new line, or the length if there is none. The
+    C library memchr() is already vectorized, so it's used directly.
+*/
+size_t find_line_end(const char* buf, size_t pos, size_t len) {
+
+    if(pos >= len)
+        return len;
+
+    const char* ptr = memchr(&buf[pos], '\n', len - pos);
+    return (ptr != NULL)? (size_t)(ptr - buf): len;
+}
+
+/*
+    Return the offset just past the next "*\/", or the length if the comment
+    is not terminated.
+*/
+size_t find_comment_end(const char* buf, size_t pos, size_t len) {
+
+#if defined(__AVX2__)
+    const __m256i star = _mm256_set1_epi8('*');
+    const __m256i slash = _mm256_set1_epi8('/');
+
+    for(; pos + 33 <= len; pos += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)&buf[pos]);
+        __m256i b = _mm256_loadu_si256((const __m256i*)&buf[pos+1]);
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(
+                            _mm256_and_si256(_mm256_cmpeq_epi8(a, star),
+                                            _mm256_cmpeq_epi8(b, slash)));
+        if(mask != 0)
+            return pos + __builtin_ctz(mask) + 2;
+    }
+#elif defined(__SSE2__)
+    const __m128i star = _mm_set1_epi8('*');
+    const __m128i slash = _mm_set1_epi8('/');
+
+    for(; pos + 17 <= len; pos += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)&buf[pos]);
+        __m128i b = _mm_loadu_si128((const __m128i*)&buf[pos+1]);
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(
+                            _mm_and_si128(_mm_cmpeq_epi8(a, star),
+                                        _mm_cmpeq_epi8(b, slash)));
+        if(mask != 0)
+            return pos + __builtin_ctz(mask) + 2;
+    }
+#endif
+    return find_comment_end_scalar(buf, pos, len);
+}
+
+/*
+    Return the offset of the next quote given, back slash or new line, or the
+    length if there is none. These are the characters that end the plain run
+    of a string.
+*/
+size_t find_string_stop(const char* buf, size_t pos, size_t len, int quote) {
+
+#if defined(__AVX2__)
+    const __m256i qt = _mm256_set1_epi8(quote);
+    const __m256i bs = _mm256_set1_epi8('\\');
+    const __m256i nl = _mm256_set1_epi8('\n');
+
+    for(; pos + 32 <= len; pos += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)&buf[pos]);
+        __m256i stop = _mm256_or_si256(_mm256_cmpeq_epi8(v, qt),
+                            _mm256_or_si256(_mm256_cmpeq_epi8(v, bs), _mm256_cmpeq_epi8(v, nl)));
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(stop);
+        if(mask != 0)
+            return pos + __builtin_ctz(mask);
+    }
+#elif defined(__SSE2__)
+    const __m128i qt = _mm_set1_epi8(quote);
+    const __m128i bs = _mm_set1_epi8('\\');
+    const __m128i nl = _mm_set1_epi8('\n');
+
+    for(; pos + 16 <= len; pos += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)&buf[pos]);
+        __m128i stop = _mm_or_si128(_mm_cmpeq_epi8(v, qt),
+                            _mm_or_si128(_mm_cmpeq_epi8(v, bs), _mm_cmpeq_epi8(v, nl)));
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(stop);
+        if(mask != 0)
+            return pos + __builtin_ctz(mask);
+    }
+#endif
+    return find_string_stop_scalar(buf, pos, len, quote);
+}
@@ -10,7 +10,7 @@ static void get_hex_escape() {
     memset(tbuf, 0, sizeof(tbuf));
     for(idx = 0; idx < (int)sizeof(tbuf); idx++) {
         ch = get_char();
-        if(isxdigit(ch))
+        if(IS_CLASS(ch, CC_HEX))
             tbuf[idx] = ch;
         else
             break;
@@ -22,7 +22,7 @@ static void get_hex_escape() {
     }
     else {
         int val = (int)strtol(tbuf, NULL, 16);
-        add_char_buffer_int(scanner_buffer, val);
+        add_char_buffer_int(scanner->string_buffer, val);
     }
 }
 
@@ -34,7 +34,7 @@ static void get_octal_escape() {
     memset(tbuf, 0, sizeof(tbuf));
     for(idx = 0; idx < (int)sizeof(tbuf); idx++) {
         ch = get_char();
-        if(ch >= '0' && ch <= '7')
+        if(IS_CLASS(ch, CC_OCTAL))
             tbuf[idx] = ch;
         else
             break;
@@ -46,7 +46,7 @@ static void get_octal_escape() {
     }
     else {
         int val = (int)strtol(tbuf, NULL, 8);
-        add_char_buffer(scanner_buffer, val);
+        add_char_buffer(scanner->string_buffer, val);
     }
 }
 
@@ -65,7 +65,7 @@ static void get_decimal_escape() {
 
     for(; idx < (int)sizeof(tbuf); idx ++) {
         ch = get_char();
-        if(isdigit(ch))
+        if(IS_CLASS(ch, CC_DIGIT))
             tbuf[idx] = ch;
         else
             break;
@@ -77,7 +77,7 @@ static void get_decimal_escape() {
     }
     else {
         int val = (int)strtol(tbuf, NULL, 10);
-        add_char_buffer_int(scanner_buffer, val);
+        add_char_buffer_int(scanner->string_buffer, val);
     }
 }
 
@@ -92,34 +92,61 @@ static void get_string_esc() {
         case 'd':
         case 'D': get_decimal_escape(); break;
         case '0': get_octal_escape(); break;
-        case 'n': add_char_buffer(scanner_buffer, '\n'); break;
-        case 'r': add_char_buffer(scanner_buffer, '\r'); break;
-        case 't': add_char_buffer(scanner_buffer, '\t'); break;
-        case 'b': add_char_buffer(scanner_buffer, '\b'); break;
-        case 'f': add_char_buffer(scanner_buffer, '\f'); break;
-        case 'v': add_char_buffer(scanner_buffer, '\v'); break;
-        case '\\': add_char_buffer(scanner_buffer, '\\'); break;
-        case '\"': add_char_buffer(scanner_buffer, '\"'); break;
-        case '\'': add_char_buffer(scanner_buffer, '\''); break;
-        default: add_char_buffer(scanner_buffer, ch); break;
+        case 'n': add_char_buffer(scanner->string_buffer, '\n'); break;
+        case 'r': add_char_buffer(scanner->string_buffer, '\r'); break;
+        case 't': add_char_buffer(scanner->string_buffer, '\t'); break;
+        case 'b': add_char_buffer(scanner->string_buffer, '\b'); break;
+        case 'f': add_char_buffer(scanner->string_buffer, '\f'); break;
+        case 'v': add_char_buffer(scanner->string_buffer, '\v'); break;
+        case '\\': add_char_buffer(scanner->string_buffer, '\\'); break;
+        case '\"': add_char_buffer(scanner->string_buffer, '\"'); break;
+        case '\'': add_char_buffer(scanner->string_buffer, '\''); break;
+        default: add_char_buffer(scanner->string_buffer, ch); break;
     }
 }
 
+// Finish a string that is an exact copy of the source. The closing quote has
+// been read.
+static void raw_slice(size_t start) {
+
+    scanner->tok_slice.file_id = scanner->top->file_id;
+    scanner->tok_slice.offset = start;
+    scanner->tok_slice.length = scanner->top->index - 1 - start;
+}
+
 // when this is entered, a (") has been seen and discarded. This function
 // performs escape replacements, but it does not do formatting. that takes
 // place in the parser. If consecutive strings are encountered, separated
 // only by white space, then it is a string continuance and is a multi line
 // string.
+//
+// A string without escapes is left in the source. When the first escape is
+// seen, the string is copied to the side buffer and the rest of it is built
+// there. The runs between escapes are found with find_string_stop() and
+// copied whole.
 token_t read_dquote() {
 
     int finished = 0;
     int ch;
-    token_t tok = QSTRG_TOKEN;
+    file_stack_t* fsp = scanner->top;
+    size_t start = fsp->index;
+    size_t side_start = 0;
+    int copied = 0;
 
     while(!finished) {
+        size_t stop = find_string_stop(fsp->buffer, fsp->index, fsp->length, '\"');
+        if(copied)
+            add_char_buffer_mem(scanner->string_buffer, &fsp->buffer[fsp->index], stop - fsp->index);
+        fsp->index = stop;
+
         ch = get_char();
         switch(ch) {
             case '\\':
+                if(!copied) {
+                    side_start = get_char_buffer_len(scanner->string_buffer);
+                    add_char_buffer_mem(scanner->string_buffer, &fsp->buffer[start], fsp->index - 1 - start);
+                    copied++;
+                }
                 get_string_esc();
                 break;
             case '\"':
@@ -128,15 +155,32 @@ token_t read_dquote() {
             case '\n':
                 syntax("line breaks are not allowed in a string.");
                 eat_until_ws();
+                set_tok_slice(start - 1);
+                return ERROR_TOKEN;
+                break;
+            case END_FILE:
+                syntax("end of file in a string.");
+                set_tok_slice(start - 1);
                 return ERROR_TOKEN;
                 break;
             default:
-                add_char_buffer(scanner_buffer, ch);
+                if(copied)
+                    add_char_buffer(scanner->string_buffer, ch);
                 break;
         }
     }
 
-    return tok;
+    if(copied) {
+        scanner->tok_slice.file_id = SLICE_SIDE_BUFFER;
+        scanner->tok_slice.offset = side_start;
+        scanner->tok_slice.length = get_char_buffer_len(scanner->string_buffer) - side_start;
+        // terminate it so get_tok_str() can hand it out directly
+        add_char_buffer(scanner->string_buffer, 0);
+    }
+    else
+        raw_slice(start);
+
+    return QSTRG_TOKEN;
 }
 
 // when this is entered, a (') has been seen and discarded. This function
@@ -147,9 +191,11 @@ token_t read_squote() {
 
     int finished = 0;
     int ch;
-    token_t tok = QSTRG_TOKEN;
+    file_stack_t* fsp = scanner->top;
+    size_t start = fsp->index;
 
     while(!finished) {
+        fsp->index = find_string_stop(fsp->buffer, fsp->index, fsp->length, '\'');
         ch = get_char();
         switch(ch) {
             case '\'':
@@ -158,13 +204,19 @@ token_t read_squote() {
             case '\n':
                 syntax("line breaks are not allowed in a string.");
                 eat_until_ws();
+                set_tok_slice(start - 1);
+                return ERROR_TOKEN;
+                break;
+            case END_FILE:
+                syntax("end of file in a string.");
+                set_tok_slice(start - 1);
                 return ERROR_TOKEN;
                 break;
             default:
-                add_char_buffer(scanner_buffer, ch);
                 break;
         }
     }
 
-    return tok;
+    raw_slice(start);
+    return QSTRG_TOKEN;
 }
@@ -3,122 +3,85 @@
 #include "local.h"
 
 // Read a word from the input and then find out if it's a keyword or a symbol.
+// The text is left in the source, get_tok() makes the slice.
 token_t read_word() {
 
     int c;
-    int finished = 0;
+    size_t start = scanner->top->index;
 
-    while(!finished) {
-        c = get_char();
-        if(isalnum(c) || c == '_')
-            add_char_buffer(scanner_buffer, c);
-        else {
-            finished++;
-        }
-    }
+    while(IS_CLASS(c = get_char(), CC_IDENT))
+        ;
     unget_char(c);
-    const char* find = get_char_buffer(scanner_buffer);
 
-    return str_to_token(find);
+    const char* str = &scanner->top->buffer[start];
+    size_t len = scanner->top->index - start;
+
+    // no keyword starts with a '_'
+    token_t tok = (str[0] == '_')? SYMBOL_TOKEN: find_keyword(str, len);
+    if(tok == SYMBOL_TOKEN)
+        scanner->tok_id = intern_mem(str, len);
+    return tok;
 }
 
-// When this is entered, a punctuation character has been read. If it's a (_)
-// then we have a symbol, otherwise, it's an operator.
+/*
+    Operators
+
+    The operators are recognized by a small DFA. The state after the first
+    character has the token for the single character operator and the
+    characters that can follow it to make a two character operator. There are
+    no operators longer than two characters, so that is the whole machine. A
+    first character with no token is not an operator.
+*/
+#define MAX_OP_NEXT     (2)
+
+typedef struct {
+    token_t tok;
+    const char next[MAX_OP_NEXT+1];
+    token_t next_tok[MAX_OP_NEXT];
+} op_state_t;
+
+static const op_state_t op_states[128] = {
+    ['*'] = {MUL_TOKEN},
+    ['%'] = {MOD_TOKEN},
+    [','] = {COMMA_TOKEN},
+    [';'] = {SEMIC_TOKEN},
+    [':'] = {COLON_TOKEN},
+    ['['] = {OSQU_TOKEN},
+    [']'] = {CSQU_TOKEN},
+    ['{'] = {OCUR_TOKEN},
+    ['}'] = {CCUR_TOKEN},
+    ['('] = {OPAR_TOKEN},
+    [')'] = {CPAR_TOKEN},
+    ['.'] = {DOT_TOKEN},
+    ['|'] = {OR_TOKEN},     // comparison
+    ['&'] = {AND_TOKEN},    // comparison
+
+    ['='] = {EQU_TOKEN, "=", {EQUALITY_TOKEN}},
+    ['<'] = {LT_TOKEN, "=>", {LTE_TOKEN, NEQ_TOKEN}},
+    ['>'] = {GT_TOKEN, "=", {GTE_TOKEN}},
+    ['-'] = {SUB_TOKEN, "-", {DEC_TOKEN}},
+    ['+'] = {ADD_TOKEN, "+", {INC_TOKEN}},
+    ['!'] = {NOT_TOKEN, "=", {NEQ_TOKEN}},
+};
+
+// When this is entered, an operator character has been read. Returns the
+// token of the longest operator that matches.
 token_t read_punct(int ch) {
 
-    if(ch == '_') {
-        unget_char('_');
-        // wasteful binary search for something that is certinly a symbol
-        return read_word();
-    }
-    else {
-        switch(ch) {
-            // single character operators
-            case '*': return MUL_TOKEN; break;
-            case '%': return MOD_TOKEN; break;
-            case ',': return COMMA_TOKEN; break;
-            case ';': return SEMIC_TOKEN; break;
-            case ':': return COLON_TOKEN; break;
-            case '[': return OSQU_TOKEN; break;
-            case ']': return CSQU_TOKEN; break;
-            case '{': return OCUR_TOKEN; break;
-            case '}': return CCUR_TOKEN; break;
-            case '(': return OPAR_TOKEN; break;
-            case ')': return CPAR_TOKEN; break;
-            case '.': return DOT_TOKEN; break;
-            case '|': return OR_TOKEN; break; // comparison
-            case '&': return AND_TOKEN; break; // comparison
+    const op_state_t* state = (ch >= 0 && ch < 128)? &op_states[ch]: NULL;
 
-            // could be single or double
-            case '=': {
-                    int c = get_char();
-                    if(c == '=')
-                        return EQUALITY_TOKEN;
-                    else {
-                        unget_char(c);
-                        return EQU_TOKEN;
-                    }
-                }
-                break;
-            case '<': {
-                    int c = get_char();
-                    if(c == '=')
-                        return LTE_TOKEN;
-                    else if(c == '>')
-                        return NEQ_TOKEN;
-                    else {
-                        unget_char(c);
-                        return LT_TOKEN;
-                    }
-                }
-                break;
-            case '>': {
-                    int c = get_char();
-                    if(c == '=')
-                        return GTE_TOKEN;
-                    else {
-                        unget_char(c);
-                        return GT_TOKEN;
-                    }
-                }
-                break;
-            case '-': {
-                    int c = get_char();
-                    if(c == '-')
-                        return DEC_TOKEN;
-                    else {
-                        unget_char(c);
-                        return SUB_TOKEN;
-                    }
-                }
-                break;
-            case '+': {
-                    int c = get_char();
-                    if(c == '+')
-                        return INC_TOKEN;
-                    else {
-                        unget_char(c);
-                        return ADD_TOKEN;
-                    }
-                }
-                break;
-            case '!': {
-                    int c = get_char();
-                    if(c == '=')
-                        return NEQ_TOKEN;
-                    else {
-                        unget_char(c);
-                        return NOT_TOKEN;
-                    }
-                }
-                break;
+    if(state == NULL || state->tok == NONE_TOKEN) {
+        // these are not recognized
+        warning("unrecognized character in input: '%c' (0x%02X). Ignored.", ch, ch);
+        return NONE_TOKEN;
+    }
 
-            // these are not recognized
-            default:
-                warning("unrecognized character in input: '%c' (0x%02X). Ignored.", ch, ch);
-                return NONE_TOKEN;
-                break;
-        }
+    if(state->next[0] != '\0') {
+        int c = get_char();
+        for(int i = 0; state->next[i] != '\0'; i++)
+            if(state->next[i] == c)
+                return state->next_tok[i];
+        unget_char(c);
     }
-    return ERROR_TOKEN; // should never happen
+    return state->tok;
 }
@@ -0,0 +1,513 @@
+/*
+    Token ring
+
+    Tokens are scanned ahead in batches into a ring of token_info_t records.
+    get_tok() takes the next token out of the ring, peek_tok() looks ahead
+    without taking it and unget_tok() puts the last token back. Tokens that
+    have been taken stay in the ring until they are overwritten, which is what
+    allows them to be pushed back.
+
+    Tokens are counted with sequence numbers that never wrap in practice. The
+    slot of a token in the ring is its sequence number masked with the size.
+*/
+#include "common.h"
+#include <sys/mman.h>
+
+#include "scanner.h"
+#include "local.h"
+
+#define RING_MASK   (TOKEN_RING_SIZE - 1)
+
+
+// oldest token that is still in the ring
+static inline uint64_t ring_oldest() {
+
+    return (scanner->ring_end > TOKEN_RING_SIZE)? scanner->ring_end - TOKEN_RING_SIZE: 0;
+}
+
+/*
+    Scan tokens until the one with the sequence number given is in the ring. A
+    batch is scanned at a time, but a batch stops at the end of a file so that
+    a file opened by the parser is not read behind tokens that are waiting.
+*/
+static void fill_ring(uint64_t want) {
+
+    uint64_t target = scanner->ring_next + TOKEN_BATCH;
+    if(target <= want)
+        target = want + 1;
+    if(target > scanner->ring_next + MAX_LOOKAHEAD)
+        target = scanner->ring_next + MAX_LOOKAHEAD;
+
+    scanner->scanning++;
+    while(scanner->ring_end < target) {
+        token_info_t info;
+        scan_token(&info);
+        scanner->ring[scanner->ring_end & RING_MASK] = info;
+        scanner->ring_end++;
+
+        if((info.tok == END_OF_FILE || info.tok == END_OF_INPUT) && scanner->ring_end > want)
+            break;
+    }
+    scanner->scanning = 0;
+}
+
+/*
+    Returns the next token.
+*/
+token_t get_tok() {
+
+    if(scanner->ring_next >= scanner->ring_end)
+        fill_ring(scanner->ring_next);
+
+    scanner->cur_tok = scanner->ring[scanner->ring_next & RING_MASK];
+    scanner->ring_next++;
+    scanner->tok_str_ready = 0;
+    return scanner->cur_tok.tok;
+}
+
+/*
+    Return the token that get_tok() will return after n more calls without
+    taking it. peek_tok(0) is the next token. Looking further ahead than
+    MAX_LOOKAHEAD tokens is an error.
+*/
+token_t peek_tok(int n) {
+
+    const token_info_t* info = peek_tok_info(n);
+    return (info != NULL)? info->tok: ERROR_TOKEN;
+}
+
+/*
+    Same as peek_tok(), but returns the whole record for the token. The record
+    is only good until the next call to the scanner.
+*/
+const token_info_t* peek_tok_info(int n) {
+
+    if(n < 0 || n >= MAX_LOOKAHEAD) {
+        warning("cannot look ahead %d tokens", n);
+        return NULL;
+    }
+
+    if(scanner->ring_next + n >= scanner->ring_end)
+        fill_ring(scanner->ring_next + n);
+    return &scanner->ring[(scanner->ring_next + n) & RING_MASK];
+}
+
+/*
+    Push the last token returned by get_tok() back, so that it's returned
+    again. This can be done repeatedly for as long as the tokens are still in
+    the ring.
+*/
+void unget_tok() {
+
+    if(scanner->ring_next == 0 || scanner->ring_next <= ring_oldest()) {
+        warning("cannot push back any more tokens");
+        return;
+    }
+
+    scanner->ring_next--;
+    if(scanner->ring_next > ring_oldest())
+        scanner->cur_tok = scanner->ring[(scanner->ring_next - 1) & RING_MASK];
+    else
+        clear_tok_info(&scanner->cur_tok);
+    scanner->tok_str_ready = 0;
+}
+
+/*
+    Move the tokens that have been scanned but not taken out of the ring. This
+    is done when a new file is opened. They are given back by restore_tokens()
+    when that file is closed. Returns the number of tokens in the array.
+*/
+int stash_tokens(token_info_t** arr) {
+
+    int count = (int)(scanner->ring_end - scanner->ring_next);
+
+    *arr = NULL;
+    if(count > 0) {
+        *arr = MALLOC(count * sizeof(token_info_t));
+        for(int i = 0; i < count; i++)
+            (*arr)[i] = scanner->ring[(scanner->ring_next + i) & RING_MASK];
+        scanner->ring_end = scanner->ring_next;
+    }
+    return count;
+}
+
+void restore_tokens(token_info_t* arr, int count) {
+
+    for(int i = 0; i < count; i++) {
+        scanner->ring[scanner->ring_end & RING_MASK] = arr[i];
+        scanner->ring_end++;
+    }
+}
+
+/*
+    Token blocks
+
+    A block holds the tokens as parallel arrays instead of records, so a pass
+    that only looks at the token kinds only touches the kinds.
+*/
+static void grow_block(token_block_t* block, int count) {
+
+    if(block->count + block->gap_len + count > block->capacity) {
+        while(block->count + block->gap_len + count > block->capacity)
+            block->capacity = (block->capacity == 0)? 0x01 << 8: block->capacity << 1;
+
+        block->tok = REALLOC(block->tok, block->capacity * sizeof(token_t));
+        block->file_id = REALLOC(block->file_id, block->capacity * sizeof(int));
+        block->start = REALLOC(block->start, block->capacity * sizeof(uint32_t));
+        block->length = REALLOC(block->length, block->capacity * sizeof(uint32_t));
+        block->side = REALLOC(block->side, block->capacity * sizeof(uint32_t));
+        block->side_length = REALLOC(block->side_length, block->capacity * sizeof(uint32_t));
+        block->id = REALLOC(block->id, block->capacity * sizeof(uint32_t));
+        block->value = REALLOC(block->value, block->capacity * sizeof(tok_value_t));
+    }
+}
+
+token_block_t* create_token_block(int capacity) {
+
+    token_block_t* block = (token_block_t*)CALLOC(1, sizeof(token_block_t));
+    grow_block(block, (capacity > 0)? capacity: 1);
+    return block;
+}
+
+void destroy_token_block(token_block_t* block) {
+
+    if(block != NULL) {
+        if(block->map != NULL) {
+            // the arrays are in a token cache file, see cache.c
+            munmap(block->map, block->map_len);
+            FREE(block->file_id);
+            FREE(block->id);
+            FREE(block);
+            return;
+        }
+        FREE(block->tok);
+        FREE(block->file_id);
+        FREE(block->start);
+        FREE(block->length);
+        FREE(block->side);
+        FREE(block->side_length);
+        FREE(block->id);
+        FREE(block->value);
+        if(block->side_text != NULL)
+            FREE(block->side_text);
+        FREE(block);
+    }
+}
+
+void reset_token_block(token_block_t* block) {
+
+    block->count = 0;
+    block->gap_pos = 0;
+    block->gap_len = 0;
+    block->shift = 0;
+    block->side_dead = 0;
+}
+
+// A token is added after the gap of a block that has been edited, so its
+// start is kept less the shift, like the others there.
+static inline void put_block(token_block_t* block, const token_info_t* info) {
+
+    int idx = block->count + block->gap_len;
+    block->count++;
+
+    block->tok[idx] = info->tok;
+    block->file_id[idx] = info->file_id;
+    block->start[idx] = (uint32_t)info->start;
+    if(info->file_id >= 0)
+        block->start[idx] -= block->shift;
+    block->length[idx] = (uint32_t)(info->end - info->start);
+    block->id[idx] = info->id;
+    block->value[idx] = info->value;
+    if(info->slice.file_id == SLICE_SIDE_BUFFER && info->slice.length > 0) {
+        block->side[idx] = (uint32_t)info->slice.offset;
+        block->side_length[idx] = (uint32_t)info->slice.length;
+    }
+    else {
+        block->side[idx] = BLOCK_NO_SIDE;
+        block->side_length[idx] = 0;
+    }
+}
+
+/*
+    Scan up to n tokens and add them to the end of the block. Tokens that are
+    waiting in the ring are taken first. Stops after the END_OF_INPUT token.
+    Returns the number of tokens added.
+*/
+int scan_tokens(token_block_t* block, int n) {
+
+    int added = 0;
+    token_info_t info;
+
+    grow_block(block, n);
+
+    // tokens that were already read ahead come first
+    while(added < n && scanner->ring_next < scanner->ring_end) {
+        scanner->cur_tok = scanner->ring[scanner->ring_next & RING_MASK];
+        scanner->ring_next++;
+        put_block(block, &scanner->cur_tok);
+        added++;
+        if(scanner->cur_tok.tok == END_OF_INPUT)
+            return added;
+    }
+
+    scanner->scanning++;
+    while(added < n) {
+        scan_token(&info);
+        put_block(block, &info);
+        added++;
+        if(info.tok == END_OF_INPUT)
+            break;
+    }
+    scanner->scanning = 0;
+
+    if(added > 0) {
+        // the last token scanned is the current one
+        int last = block_slot(block, block->count - 1);
+        clear_tok_info(&scanner->cur_tok);
+        scanner->cur_tok.tok = block->tok[last];
+        scanner->cur_tok.slice = get_block_slice(block, block->count - 1);
+        scanner->cur_tok.id = block->id[last];
+        scanner->cur_tok.value = block->value[last];
+        scanner->cur_tok.file_id = block->file_id[last];
+        scanner->cur_tok.start = block_start(block, block->count - 1);
+        scanner->cur_tok.end = scanner->cur_tok.start + block->length[last];
+        scanner->tok_str_ready = 0;
+    }
+    return added;
+}
+
+/*
+    Return the slice of the text of token i in the block. A block that has been
+    edited is read around its gap, without changing it.
+*/
+tok_slice_t get_block_slice(token_block_t* block, int i) {
+
+    tok_slice_t slice;
+    int k = block_slot(block, i);
+
+    if(block->side[k] != BLOCK_NO_SIDE) {
+        slice.file_id = SLICE_SIDE_BUFFER;
+        slice.offset = block->side[k];
+        slice.length = block->side_length[k];
+    }
+    else if(block->tok[k] == QSTRG_TOKEN && block->length[k] >= 2) {
+        // the text of a string does not include the quotes
+        slice.file_id = block->file_id[k];
+        slice.offset = block_start(block, i) + 1;
+        slice.length = block->length[k] - 2;
+    }
+    else {
+        slice.file_id = block->file_id[k];
+        slice.offset = block_start(block, i);
+        slice.length = block->length[k];
+    }
+    return slice;
+}
+
+/*
+    Copy the side buffer of the scanner into the block, so that the text of
+    strings with escapes is kept after the scanner is gone. This is done when
+    the block was scanned by a different scanner than the one that will read
+    it.
+*/
+void keep_block_text(token_block_t* block) {
+
+    size_t len = get_char_buffer_len(scanner->string_buffer);
+
+    if(block->side_text != NULL)
+        FREE(block->side_text);
+    block->side_text = MALLOC(len + 1);
+    memcpy(block->side_text, get_char_buffer(scanner->string_buffer), len);
+    block->side_text[len] = '\0';
+    block->side_len = len;
+}
+
+// Copy the arrays of a block that is in a token cache file, so that it can
+// be changed.
+static void unmap_block(token_block_t* block) {
+
+    token_block_t* copy = create_token_block(block->count);
+
+    memcpy(copy->tok, block->tok, block->count * sizeof(token_t));
+    memcpy(copy->file_id, block->file_id, block->count * sizeof(int));
+    memcpy(copy->start, block->start, block->count * sizeof(uint32_t));
+    memcpy(copy->length, block->length, block->count * sizeof(uint32_t));
+    memcpy(copy->side, block->side, block->count * sizeof(uint32_t));
+    memcpy(copy->side_length, block->side_length, block->count * sizeof(uint32_t));
+    memcpy(copy->id, block->id, block->count * sizeof(uint32_t));
+    memcpy(copy->value, block->value, block->count * sizeof(tok_value_t));
+    copy->side_text = MALLOC(block->side_len + 1);
+    memcpy(copy->side_text, block->side_text, block->side_len + 1);
+    copy->side_len = block->side_len;
+
+    // the file ids and the symbol ids were allocated, see read_cache()
+    munmap(block->map, block->map_len);
+    FREE(block->file_id);
+    FREE(block->id);
+    copy->count = block->count;
+    *block = *copy;
+    FREE(copy);
+}
+
+#define MOVE_SLOTS(arr, to, from, n) \
+    memmove(&block->arr[to], &block->arr[from], (n) * sizeof(block->arr[0]))
+
+// Move n tokens in all of the arrays of the block.
+static void move_slots(token_block_t* block, int to, int from, int n) {
+
+    MOVE_SLOTS(tok, to, from, n);
+    MOVE_SLOTS(file_id, to, from, n);
+    MOVE_SLOTS(start, to, from, n);
+    MOVE_SLOTS(length, to, from, n);
+    MOVE_SLOTS(side, to, from, n);
+    MOVE_SLOTS(side_length, to, from, n);
+    MOVE_SLOTS(id, to, from, n);
+    MOVE_SLOTS(value, to, from, n);
+}
+
+/*
+    Move the gap that splice_block() leaves in the arrays to just before token
+    pos. The tokens after the gap start shift bytes later than their start
+    says, so a token that is moved across the gap has the shift added to its
+    start or taken off of it. Only the tokens between the old place and the new
+    one are touched.
+*/
+static void move_block_gap(token_block_t* block, int pos) {
+
+    int gap = block->gap_len;
+
+    if(gap == 0 && block->shift == 0) {
+        block->gap_pos = pos;
+        return;
+    }
+
+    if(pos < block->gap_pos) {
+        move_slots(block, pos + gap, pos, block->gap_pos - pos);
+        for(int i = pos + gap; i < block->gap_pos + gap; i++)
+            if(block->file_id[i] >= 0)
+                block->start[i] -= block->shift;
+    }
+    else {
+        move_slots(block, block->gap_pos, block->gap_pos + gap, pos - block->gap_pos);
+        for(int i = block->gap_pos; i < pos; i++)
+            if(block->file_id[i] >= 0)
+                block->start[i] += block->shift;
+    }
+    block->gap_pos = pos;
+}
+
+/*
+    Close the gap that relex_tokens() left in the block and give the tokens
+    after it their real starts. This moves every token after the gap, so the
+    scanner does not do it. It's for code that reads the arrays of a block
+    that has been edited directly.
+*/
+void settle_block(token_block_t* block) {
+
+    if(block->gap_len > 0 || block->shift != 0) {
+        move_block_gap(block, block->count);
+        block->gap_len = 0;
+        block->shift = 0;
+    }
+}
+
+#define SPLICE(arr) \
+    memcpy(&block->arr[pos], ins->arr, ins->count * sizeof(block->arr[0]))
+
+/*
+    Replace del tokens of the block, starting at pos, with the tokens of the
+    other block, and move the starts of the tokens after them by shift bytes.
+    The side offsets of the tokens put in must already be offsets in the side
+    text of this block.
+
+    The tokens after the edit are not moved in the arrays and their starts are
+    not changed. The gap is moved to the edit, the tokens that are replaced
+    become part of it, and the shift is added to the one that the tokens after
+    the gap already have. So the cost is that of the tokens put in and the ones
+    between this edit and the last one, not that of the whole block.
+*/
+void splice_block(token_block_t* block, int pos, int del, token_block_t* ins, uint32_t shift) {
+
+    if(block->map != NULL)
+        unmap_block(block);
+
+    move_block_gap(block, pos);
+    block->gap_len += del;
+    block->count -= del;
+
+    if(block->gap_len < ins->count) {
+        // make the gap bigger, with the tokens after it at the end of the arrays
+        int tail = block->count - block->gap_pos;
+        int from = block->gap_pos + block->gap_len;
+        grow_block(block, ins->count - block->gap_len);
+        move_slots(block, block->capacity - tail, from, tail);
+        block->gap_len = block->capacity - tail - block->gap_pos;
+    }
+
+    SPLICE(tok);
+    SPLICE(file_id);
+    SPLICE(start);
+    SPLICE(length);
+    SPLICE(side);
+    SPLICE(side_length);
+    SPLICE(id);
+    SPLICE(value);
+    block->gap_pos += ins->count;
+    block->gap_len -= ins->count;
+    block->count += ins->count;
+    block->shift += shift;
+}
+
+/*
+    Take the next token from the block of a file that was scanned ahead of
+    time. Text that was in the side buffer of the scanner that made the block
+    is copied to the side buffer of this one. The block ends with the
+    END_OF_FILE token.
+*/
+token_t replay_token(token_info_t* info) {
+
+    file_stack_t* fsp = scanner->top;
+    token_block_t* block = fsp->block;
+    int idx = fsp->block_pos;
+    int k = block_slot(block, idx);
+
+    if(idx >= block->count || block->tok[k] == END_OF_INPUT) {
+        // the block was cut short, end the file anyway
+        clear_tok_info(info);
+        info->tok = END_OF_FILE;
+        info->file_id = fsp->file_id;
+        info->start = info->end = fsp->index;
+        scanner->file_flag++;
+        return END_OF_FILE;
+    }
+
+    fsp->block_pos++;
+    info->tok = block->tok[k];
+    info->id = block->id[k];
+    info->value = block->value[k];
+    info->file_id = block->file_id[k];
+    info->start = block_start(block, idx);
+    info->slice = get_block_slice(block, idx);
+
+    if(info->slice.file_id == SLICE_SIDE_BUFFER && block->side_text != NULL) {
+        info->slice.offset = get_char_buffer_len(scanner->string_buffer);
+        add_char_buffer_mem(scanner->string_buffer,
+                    &block->side_text[block->side[k]], info->slice.length);
+        add_char_buffer(scanner->string_buffer, 0);
+    }
+
+    info->end = info->start + block->length[k];
+    fsp->index = info->end;
+
+    if(info->tok == END_OF_FILE)
+        scanner->file_flag++;
+    return info->tok;
+}
+
+/*
+    Returns non-zero if a token has been taken out of the ring.
+*/
+int have_tok() {
+
+    return scanner->ring_next > 0;
+}
@@ -97,20 +97,34 @@ static symbol_table_t* peek_symbol_table() {
 }
 
 /**
- * Recursively destroy all allocated data in the symbol tree.
+ * Recursively destroy all allocated data in the symbol tree. Each table has a
+ * walk of its own, so the walk of the parent is not lost when a child table
+ * is destroyed.
  */
-static void recurse_destroy(hashtable_t* ht) {
+static void recurse_destroy(symbol_table_t* tab) {
 
-    symbol_t* sym;
+    hash_iter_t iter;
 
-    for(sym = iterate_hash_table(ht, 1); sym != NULL; sym = iterate_hash_table(ht, 1)) {
-        if(sym->table != NULL) {
+    init_hash_iter(&iter, tab);
+    while(next_hash_iter(&iter) != NULL) {
+        symbol_t* sym = get_hash_iter_data(&iter);
+        if(sym->table != NULL)
             recurse_destroy(sym->table);
-            if(sym->assign_type == SYM_STRING_TYPE && sym->const_val.str_val != NULL)
-                FREE(sym->const_val.str_val);
-        }
-        destroy_hash_table(ht);
+        if(sym->assign_type == SYM_STRING_TYPE && sym->const_val.str_val != NULL)
+            FREE(sym->const_val.str_val);
     }
+    destroy_hash_table(tab);
+}
+
+/**
+ * Destroy a symbol that is not in a table, such as the symbol of a module,
+ * and all of the symbols under it.
+ */
+void destroy_symbol(symbol_t* sym) {
+
+    if(sym->table != NULL)
+        recurse_destroy(sym->table);
+    FREE(sym);
 }
 
 /**
@@ -119,8 +133,7 @@ static void recurse_destroy(hashtable_t* ht) {
 static void destroy_symbol_table() {
 
     destroy_char_buffer(deco_buffer);
-    //destroy_hash_table(htable);
-    recurse_destroy(htable);
+    recurse_destroy(sym_tab);
 }
 
 /**
@@ -128,7 +141,7 @@ static void destroy_symbol_table() {
  */
 void init_symbol_table() {
 
-    symbol_table_t* sym_tab = (symbol_table_t*)create_hash_table();
+    sym_tab = (symbol_table_t*)create_hash_table_sized(sizeof(symbol_t));
     push_symbol_table(sym_tab);
     deco_buffer = create_char_buffer();
 
@@ -149,7 +162,7 @@ symbol_t* create_symbol() {
  */
 symbol_table_t* create_symbol_table(symbol_t* sym) {
 
-    symbol_table_t* stab = (symbol_table_t*)create_hash_table();
+    symbol_table_t* stab = (symbol_table_t*)create_hash_table_sized(sizeof(symbol_t));
     if(sym != NULL) {
         sym->table = stab;
         push_symbol_table(stab);
@@ -157,6 +170,15 @@ symbol_table_t* create_symbol_table(symbol_t* sym) {
     return stab;
 }
 
+/**
+ * Done adding symbols to the table on the top of the symbol table stack, such
+ * as when the file of a module ends. The table is still owned by its symbol.
+ */
+void close_symbol_table() {
+
+    pop_symbol_table();
+}
+
 /**
  * Add the name to the symbol table that is on the top of the symbol table stack.
  * If there is no symbol table on the top of the stack, then create one.
@@ -200,7 +222,19 @@ symbol_error_t get_symbol(symbol_table_t* tab, const char* name, symbol_t* sym)
 }
 
 /**
- * Replace the symbol data with the structure supplied.
+ * Get a pointer to the symbol in the table, or NULL if it is not there. The
+ * symbol can be changed through the pointer without copying it in and out
+ * with get_symbol() and update_symbol(). It is good until the symbol is
+ * removed from the table.
+ */
+symbol_t* find_symbol(symbol_table_t* tab, const char* name) {
+
+    return (symbol_t*)find_hash_ref(tab, name);
+}
+
+/**
+ * Replace the symbol data with the structure supplied. The symbol tables
+ * have the size of a symbol, so this copies it in place.
  */
 symbol_error_t update_symbol(symbol_table_t* tab, const char* name, symbol_t* sym) {
 
@@ -14,7 +14,8 @@ typedef struct {
 static void grow_buffer(__chbuf_t* buf, size_t size) {
 
     if(buf->length+size+2 > buf->capacity) {
-        buf->capacity = buf->capacity << 1;
+        while(buf->length+size+2 > buf->capacity)
+            buf->capacity = buf->capacity << 1;
         buf->buffer = REALLOC(buf->buffer, buf->capacity);
     }
 }
@@ -51,6 +52,12 @@ const char* get_char_buffer(char_buffer_t chbuf) {
     return buf->buffer;
 }
 
+size_t get_char_buffer_len(char_buffer_t chbuf) {
+
+    __chbuf_t* buf = (__chbuf_t*)chbuf;
+    return buf->length;
+}
+
 // This will write any 8 bit value to the buffer.
 void add_char_buffer(char_buffer_t chbuf, int ch) {
 
@@ -62,6 +69,17 @@ void add_char_buffer(char_buffer_t chbuf, int ch) {
     buf->buffer[buf->length] = 0;
 }
 
+// Copy a run of bytes that is not necessarily terminated.
+void add_char_buffer_mem(char_buffer_t chbuf, const char* str, size_t len) {
+
+    __chbuf_t* buf = (__chbuf_t*)chbuf;
+
+    grow_buffer(buf, len);
+    memcpy(&buf->buffer[buf->length], str, len);
+    buf->length += len;
+    buf->buffer[buf->length] = 0;
+}
+
 void add_char_buffer_str(char_buffer_t chbuf, const char* str) {
 
     for(int i = 0; str[i] != 0; i ++)
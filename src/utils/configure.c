@@ -127,8 +127,9 @@ void destroy_config(void) {
             case CONFIG_TYPE_LIST: {
                     fprintf(stderr, "CFG: list: %s\n", _global_config[i].name);
                     ptr_list_t* lst = _global_config[i].value.list;
-                    reset_ptr_list(lst);
-                    for(void* item = get_ptr_list_next(lst); item != NULL; item = get_ptr_list_next(lst)) {
+                    ptr_list_iter_t iter;
+                    init_ptr_list_iter(&iter, lst);
+                    for(void* item = next_ptr_list_iter(&iter); item != NULL; item = next_ptr_list_iter(&iter)) {
                         fprintf(stderr, "CFG: list item: %s\n", (char*)item);
                         FREE(item);
                     }
@@ -160,7 +161,7 @@ int configure(int argc, char** argv) {
     for(idx = 1; idx < argc; idx++) {
         config = find_config_by_arg(argv[idx]);
         if(config == NULL) {
-            if(argv[idx][0] == '-') {
+            if(argv[idx][0] == '-' && argv[idx][1] != '\0') {
                 fprintf(stderr, "CMD ERROR: Unknown configuration parameter: \"%s\"\n", argv[idx]);
                 show_use(); // does not return
             }
@@ -323,14 +324,14 @@ char* iterate_config(const char* name) {
             break;
 
         case CONFIG_TYPE_LIST:
-            // This type actually gets iterated. use strtok_r() to iterate it.
+            // This type actually gets iterated. The config keeps where it is in the list.
             if(config->iter_buf != NULL) {
-                config->iter_buf = get_ptr_list_next(config->value.list);
+                config->iter_buf = next_ptr_list_iter(&config->list_iter);
                 retv = config->iter_buf;
             }
             else {
-                reset_ptr_list(config->value.list);
-                config->iter_buf = get_ptr_list_next(config->value.list);
+                init_ptr_list_iter(&config->list_iter, config->value.list);
+                config->iter_buf = next_ptr_list_iter(&config->list_iter);
                 retv = config->iter_buf;
             }
             break;
@@ -347,7 +348,7 @@ void reset_config_list(const char* name) {
 
     configuration_t* config = find_config_by_name(name);
     if(config->type == CONFIG_TYPE_LIST)
-        reset_ptr_list(config->value.list);
+        init_ptr_list_iter(&config->list_iter, config->value.list);
     // else just do nothing
 }
 
@@ -393,9 +394,10 @@ void show_use(void) {
                 fprintf(stderr, "     required: %s\n", _global_config[i].required? "TRUE": "FALSE");
 
                 if(_global_config[i].value.list->nitems != 0) {
-                    ptr_list_t* list = _global_config[i].value.list;
+                    ptr_list_iter_t iter;
+                    init_ptr_list_iter(&iter, _global_config[i].value.list);
                     fprintf(stderr, "     ");
-                    for(char* ptr = get_ptr_list_next(list); ptr != NULL; ptr = get_ptr_list_next(list))
+                    for(char* ptr = next_ptr_list_iter(&iter); ptr != NULL; ptr = next_ptr_list_iter(&iter))
                         fprintf(stderr, "%s ", ptr);
                     fprintf(stderr, "\n");
                 }
@@ -9,8 +9,21 @@ static struct {
     int warnings;
 } errors;
 
-// messages longer than this will be truncated to this length.
-static char msg_buff[132];
+// messages longer than this will be truncated to this length. Each thread
+// formats its messages in its own buffer.
+static __thread char msg_buff[132];
+
+// Syntax errors and warnings from a thread can be collected in a stream of
+// its own, so they can be printed in a predictable order later.
+static __thread FILE* thread_fp = NULL;
+
+// Syntax errors and warnings reported by this thread, so a thread can tell
+// whether its own work had any without counting those of the others.
+static __thread int thread_msgs = 0;
+
+static inline FILE* msg_stream() {
+    return (thread_fp != NULL)? thread_fp: stderr;
+}
 
 static void report() {
     fprintf(errors.fp, "    errors: %d warnings: %d\n", errors.errors, errors.warnings);
@@ -41,8 +54,9 @@ void syntax(const char* str, ...) {
     va_start(args, str);
     vsnprintf(&msg_buff[len], sizeof(msg_buff) - len, str, args);
     va_end(args);
-    errors.errors++;
-    fprintf(stderr, "%s\n", msg_buff);
+    __atomic_fetch_add(&errors.errors, 1, __ATOMIC_RELAXED);
+    thread_msgs++;
+    fprintf(msg_stream(), "%s\n", msg_buff);
 }
 
 void warning(const char* str, ...) {
@@ -62,8 +76,9 @@ void warning(const char* str, ...) {
     va_start(args, str);
     vsnprintf(&msg_buff[len], sizeof(msg_buff) - len, str, args);
     va_end(args);
-    errors.warnings++;
-    fprintf(stderr, "%s\n", msg_buff);
+    __atomic_fetch_add(&errors.warnings, 1, __ATOMIC_RELAXED);
+    thread_msgs++;
+    fprintf(msg_stream(), "%s\n", msg_buff);
 }
 
 void fatal_error(const char* str, ...) {
@@ -77,7 +92,7 @@ void fatal_error(const char* str, ...) {
     va_start(args, str);
     vsnprintf(&msg_buff[len], sizeof(msg_buff) - len, str, args);
     va_end(args);
-    errors.errors++;
+    __atomic_fetch_add(&errors.errors, 1, __ATOMIC_RELAXED);
     fprintf(stderr, "%s\n", msg_buff);
     exit(1);
 }
@@ -93,29 +108,49 @@ void command_error(const char* str, ...) {
     va_start(args, str);
     vsnprintf(&msg_buff[len], sizeof(msg_buff) - len, str, args);
     va_end(args);
-    errors.errors++;
-    fprintf(stderr, "%s\n", msg_buff);
+    __atomic_fetch_add(&errors.errors, 1, __ATOMIC_RELAXED);
+    fprintf(msg_stream(), "%s\n", msg_buff);
 }
 
 int get_num_errors() {
 
-    return errors.errors;
+    return __atomic_load_n(&errors.errors, __ATOMIC_RELAXED);
 }
 
 int get_num_warnings() {
 
-    return errors.warnings;
+    return __atomic_load_n(&errors.warnings, __ATOMIC_RELAXED);
+}
+
+/*
+    Return the number of syntax errors and warnings that the calling thread
+    has reported.
+*/
+int get_thread_num_msgs() {
+
+    return thread_msgs;
 }
 
 void inc_error_count() {
 
-    errors.errors ++;
+    __atomic_fetch_add(&errors.errors, 1, __ATOMIC_RELAXED);
+    thread_msgs++;
 }
 
 void inc_warning_count() {
-    errors.warnings ++;
+    __atomic_fetch_add(&errors.warnings, 1, __ATOMIC_RELAXED);
+    thread_msgs++;
 }
 
 FILE* get_err_stream() {
-    return errors.fp;
+    return (thread_fp != NULL)? thread_fp: errors.fp;
+}
+
+/*
+    Send the syntax errors and warnings of the calling thread to the stream
+    given instead of stderr. A NULL stream puts them back on stderr. Fatal
+    errors always go to stderr.
+*/
+void set_thread_err_stream(FILE* fp) {
+    thread_fp = fp;
 }
\ No newline at end of file
@@ -1,5 +1,7 @@
 
 #include "common.h"
+#include <dirent.h>
+
 #include "scanner.h"
 
 int file_exists(char* fname) {
@@ -58,37 +60,124 @@ static char* search_cmd_path(char* name) {
     return NULL;
 }
 
-//char* find_import_file(const char* base) {
-void open_input_file(const char* base) {
+/*
+    Directory cache
+
+    The directories in the search paths (FPATH and then G_INCLUDE) are listed
+    once, the first time a file is looked for. Every file name is put in a hash
+    table with the directory that it was first seen in, so finding a file is
+    one lookup instead of trying to open it in every directory. The cache is
+    only used from the main thread. Names that have a directory in them are
+    looked for the old way.
+*/
+static hashtable_t* dir_cache = NULL;
+static ptr_list_t* search_dirs = NULL;
+
+static void list_dir(const char* dname) {
+
+    DIR* dir = opendir(dname);
+    if(dir == NULL)
+        return;
+
+    int idx = (int)search_dirs->nitems;
+    append_ptr_list(search_dirs, STRDUP(dname));
+
+    struct dirent* ent;
+    while((ent = readdir(dir)) != NULL) {
+        if(ent->d_type == DT_DIR)
+            continue;
+        // the first directory a name is found in is the one that's used
+        insert_hash(dir_cache, ent->d_name, &idx, sizeof(idx));
+    }
+    closedir(dir);
+}
+
+static void build_dir_cache() {
+
+    dir_cache = create_hash_table();
+    search_dirs = create_ptr_list();
+
+    reset_config_list("FPATH");
+    for(char* ptr = iterate_config("FPATH"); ptr != NULL; ptr = iterate_config("FPATH"))
+        list_dir(ptr);
+
+    char* tmp = getenv("G_INCLUDE");
+    if(tmp != NULL) {
+        char* save;
+        char* raw = STRDUP(tmp);
+        for(char* p = strtok_r(raw, ":", &save); p != NULL; p = strtok_r(NULL, ":", &save))
+            list_dir(p);
+        FREE(raw);
+    }
+}
+
+static char* search_dir_cache(const char* name) {
+
+    int idx;
+
+    if(dir_cache == NULL)
+        build_dir_cache();
+
+    if(find_hash(dir_cache, name, &idx, sizeof(idx)) != HASH_NO_ERROR)
+        return NULL;
+
+    const char* dname = get_ptr_list_by_index(search_dirs, idx);
+    size_t len = strlen(dname) + strlen(name) + 2;
+    char* buf = MALLOC(len);
+    snprintf(buf, len, "%s/%s", dname, name);
+    return buf; // caller must free this
+}
+
+/*
+    Find the file for an import or input name in the search paths. The ".g"
+    extention is added if it's not there. Returns the path, which the caller
+    must free, or NULL if the file was not found. Nothing is reported, so this
+    can be used to look for files ahead of opening them.
+*/
+char* find_input_file(const char* base) {
 
     char* name;
     char* tmp = NULL;
 
-    //memset(fn_buf, 0, sizeof(fn_buf));
+    // "-" is the standard input, see open_scanner_file()
+    if(!strcmp(base, "-"))
+        return STRDUP(base);
 
     name = MALLOC(256);
 
     // add the file extention if it's not present
     strncpy(name, base, 252);
+    name[252] = '\0';
     tmp = strrchr(name, '.');
-    if(tmp != NULL) {
-        if(strcmp(tmp, ".g")) {
-            warning("unknown file extention: '%s'", tmp);
-            strcat(name, ".g");
-        }
-        else
-            warning("do not include the file extention for import names");
-    }
-    else
+    if(tmp == NULL || strcmp(tmp, ".g"))
         strcat(name, ".g");
 
-    if(NULL == (tmp = search_cmd_path(name))) {
+    if(strchr(name, '/') == NULL)
+        tmp = search_dir_cache(name);
+    else if(NULL == (tmp = search_cmd_path(name))) {
         if(NULL == (tmp = search_env_path(name))) {
             tmp = NULL; // for illustration
         }
     }
 
-    open_scanner_file(tmp);
     FREE(name);
+    return tmp;
+}
+
+void open_input_file(const char* base) {
+
+    char* tmp = strrchr(base, '.');
+    if(tmp != NULL) {
+        if(strcmp(tmp, ".g"))
+            warning("unknown file extention: '%s'", tmp);
+        else
+            warning("do not include the file extention for import names");
+    }
+
+    tmp = find_input_file(base);
+    if(tmp == NULL)
+        fatal_error("cannot find input file: \"%s\"", base);
+
+    open_scanner_file(tmp);
     FREE(tmp);
 }
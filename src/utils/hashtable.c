@@ -14,8 +14,38 @@
  */
 #include "common.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
-#define TABLE_MAX_LOAD 0.75
+/*
+ * The table is a "Swiss table". Next to the entries is an array of control
+ * bytes, one for each slot. A control byte is CTRL_EMPTY, or the low 7 bits
+ * of the hash of the key in the slot. The slots are in groups of GROUP_SIZE
+ * and a lookup compares a whole group of control bytes to the tag at once,
+ * so an entry is only read when its tag is a match. Since the tags seldom
+ * match by chance, the table can be fuller than one with linear probing.
+ *
+ * The control bytes that are not full have the high bit set, so that a
+ * movemask finds the free slots of a group.
+ *
+ * A lookup stops at the first group that has an empty slot. When an entry is
+ * removed from a group that has never been full, no lookup has gone past the
+ * group, so the slot is made empty again. Otherwise it is marked deleted, so
+ * the lookups that go past it still do. The deleted slots are used again by
+ * inserts and are cleared out when the table is resized.
+ */
+#define GROUP_SIZE      16
+#define CTRL_EMPTY      ((int8_t)0x80)
+#define CTRL_DELETED    ((int8_t)0xFE)
+#define TABLE_MAX_LOAD  0.875
+#define TABLE_MIN_LOAD  0.2
+
+// values in the first slab of a table with a value size, see alloc_value()
+#define FIRST_SLAB      8
+
+#define HASH_TAG(h)     ((int8_t)((h) & 0x7F))
+#define HASH_GROUP(h)   ((h) >> 7)
 
 /*
  * Return the smaller of the two parameters.
@@ -25,16 +55,37 @@ static inline size_t _min(size_t v1, size_t v2)
     return (v1 < v2) ? v1 : v2;
 }
 
-/*
- * This is a “FNV-1a” hash function. Do not mess with the constants.
+/**
+ * @brief This is a “FNV-1a” hash function. Do not mess with the constants.
+ * The string interning uses the same hash, so the hash of an interned string
+ * can be given to the _h functions.
+ *
+ * @param key -- The string to hash.
+ * @return uint32_t -- The hash of the string.
+ */
+uint32_t hash_key(const char* key)
+{
+    uint32_t hash = 2166136261u;
+
+    for(const unsigned char* ptr = (const unsigned char*)key; *ptr != '\0'; ptr++)
+    {
+        hash ^= *ptr;
+        hash *= 16777619;
+    }
+
+    return (hash);
+}
+
+/**
+ * @brief Same as hash_key(), for a string that is not terminated.
  */
-static uint32_t make_hash(const char* key)
+uint32_t hash_key_mem(const char* key, size_t len)
 {
     uint32_t hash = 2166136261u;
 
-    for(int i = 0; i < (int)strlen(key); i++)
+    for(size_t i = 0; i < len; i++)
     {
-        hash ^= key[i];
+        hash ^= (unsigned char)key[i];
         hash *= 16777619;
     }
 
@@ -42,66 +93,240 @@ static uint32_t make_hash(const char* key)
 }
 
 /*
- * If the entry is found, return the slot, if the entry is not found, then the
- * slot returned is where to put the entry. Check the slot's key to tell the
- * difference.
+ * Return a bit mask of the control bytes of the group that are equal to the
+ * tag, bit 0 for the first slot.
+ */
+static inline uint32_t match_tag(const int8_t* ctrl, int8_t tag)
+{
+#if defined(__SSE2__)
+    __m128i group = _mm_loadu_si128((const __m128i*)ctrl);
+    return ((uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(tag))));
+#else
+    uint32_t mask = 0;
+
+    for(int i = 0; i < GROUP_SIZE; i++)
+    {
+        if(ctrl[i] == tag)
+            mask |= 0x01u << i;
+    }
+    return (mask);
+#endif
+}
+
+/*
+ * Return a bit mask of the slots of the group that do not have an entry.
  */
-static _table_entry_t* find_slot(_table_entry_t * ent, size_t cap, const char* key)
+static inline uint32_t match_free(const int8_t* ctrl)
 {
-    uint32_t index = make_hash(key) & (cap - 1);
+#if defined(__SSE2__)
+    return ((uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)ctrl)));
+#else
+    uint32_t mask = 0;
 
-    while(1)
+    for(int i = 0; i < GROUP_SIZE; i++)
     {
-        _table_entry_t* entry = &ent[index];
+        if(ctrl[i] < 0)
+            mask |= 0x01u << i;
+    }
+    return (mask);
+#endif
+}
 
-        // depends on left evaluate before right
-        if((entry->key == NULL) || (!strcmp(key, entry->key)))
+/*
+ * Return the index of the slot that holds the key, or -1 if it is not in the
+ * table. The groups are probed in a triangular sequence, which visits all of
+ * them since the number of groups is a power of 2. There is always an empty
+ * slot, so a key that is not there is found to be missing.
+ */
+static ssize_t find_slot(hashtable_t * tab, const char* key, uint32_t hash)
+{
+    size_t mask = tab->capacity / GROUP_SIZE - 1;
+    size_t group = HASH_GROUP(hash) & mask;
+    int8_t tag = HASH_TAG(hash);
+
+    for(size_t step = 1; ; step++)
+    {
+        const int8_t* ctrl = &tab->ctrl[group * GROUP_SIZE];
+
+        for(uint32_t match = match_tag(ctrl, tag); match != 0; match &= match - 1)
         {
-            return (entry);
+            size_t index = group * GROUP_SIZE + __builtin_ctz(match);
+            _table_entry_t* entry = &tab->entries[index];
+
+            // the tag has 7 bits of the hash, so check all of it first
+            if(entry->hash == hash && !strcmp(key, entry->key))
+                return ((ssize_t)index);
         }
 
-        index = (index + 1) & (cap - 1);
+        if(match_tag(ctrl, CTRL_EMPTY) != 0)
+            return (-1);
+
+        group = (group + step) & mask;
     }
-    return (NULL);
+    return (-1);
+}
+
+/*
+ * Return the index of the first slot without an entry along the probe
+ * sequence of the hash. That is where a new entry with the hash goes.
+ */
+static size_t find_free(const int8_t* ctrl, size_t cap, uint32_t hash)
+{
+    size_t mask = cap / GROUP_SIZE - 1;
+    size_t group = HASH_GROUP(hash) & mask;
+
+    for(size_t step = 1; ; step++)
+    {
+        uint32_t match = match_free(&ctrl[group * GROUP_SIZE]);
+        if(match != 0)
+            return (group * GROUP_SIZE + __builtin_ctz(match));
+
+        group = (group + step) & mask;
+    }
+    return (0);
+}
+
+/*
+ * Allocate the slots for a table of the capacity given, with all of them
+ * empty.
+ */
+static void alloc_slots(hashtable_t * tab, size_t capacity)
+{
+    tab->capacity = capacity;
+    tab->entries = (_table_entry_t *) CALLOC(capacity, sizeof(_table_entry_t));
+    tab->ctrl = (int8_t *) MALLOC(capacity);
+    memset(tab->ctrl, CTRL_EMPTY, capacity);
+}
+
+/*
+ * Move the entries to new slots of the capacity given. Since the slots change
+ * when the table size changes, this function simply re-adds them to the new
+ * table, then updates the data structure. The hashes are kept in the entries,
+ * so they are not worked out again, and there are no duplicate keys to
+ * compare. The deleted slots are left behind.
+ */
+static void resize_table(hashtable_t * tab, size_t capacity)
+{
+    _table_entry_t* old_entries = tab->entries;
+    int8_t* old_ctrl = tab->ctrl;
+    size_t old_capacity = tab->capacity;
+
+    alloc_slots(tab, capacity);
+    tab->deleted = 0;
+
+    // re-add the table entries to the new table.
+    for(size_t i = 0; i < old_capacity; i++)
+    {
+        if(old_ctrl[i] >= 0)
+        {
+            size_t index = find_free(tab->ctrl, tab->capacity, old_entries[i].hash);
+            tab->ctrl[index] = old_ctrl[i];
+            tab->entries[index] = old_entries[i];
+        }
+    }
+
+    // free the old table
+    FREE(old_entries);
+    FREE(old_ctrl);
 }
 
 /**
- * Grow the table if it needs it. Since the hash values change when the table
- * size changes, this function simply re-adds them to the new table, then
- * updates the data structure.
+ * Grow the table if it needs it. The deleted slots count against the load,
+ * since lookups have to go past them. If half of the used slots are deleted
+ * ones, the table is resized to the same capacity to clear them out.
  */
 static void grow_table(hashtable_t * tab)
 {
-    if(tab->count + 2 > tab->capacity * TABLE_MAX_LOAD)
+    if(tab->count + tab->deleted + 1 > tab->capacity * TABLE_MAX_LOAD)
     {
         // table must always be an even power of 2 for this to work.
-        size_t capacity = tab->capacity << 1;
+        if(tab->count + 1 > tab->capacity * TABLE_MAX_LOAD / 2)
+            resize_table(tab, tab->capacity << 1);
+        else
+            resize_table(tab, tab->capacity);
+    }
+}
 
-        _table_entry_t* entries = (_table_entry_t *) CALLOC(capacity, sizeof(_table_entry_t));
+/**
+ * Shrink the table if it has few entries left, so a table that had a lot of
+ * entries removed gives the memory back.
+ */
+static void shrink_table(hashtable_t * tab)
+{
+    if(tab->capacity > GROUP_SIZE && tab->count < tab->capacity * TABLE_MIN_LOAD)
+    {
+        resize_table(tab, tab->capacity >> 1);
+    }
+}
 
-        // re-add the table entries to the new table.
-        if(tab->entries != NULL)
+/*
+ * Get the memory for a value in a table with a value size. The values are
+ * in slabs that are never moved, so a pointer to a value stays good until
+ * the entry is removed. Each slab is twice the size of the one before it, so
+ * a small table does not waste much. The values that are removed are kept
+ * in a free list, linked through the values themselves.
+ */
+static void* alloc_value(hashtable_t * tab)
+{
+    void* value;
+
+    if(tab->free_values != NULL)
+    {
+        value = tab->free_values;
+        tab->free_values = *(void **)value;
+    }
+    else
+    {
+        if(tab->slab_count == 0 || tab->slab_used == ((size_t)FIRST_SLAB << (tab->slab_count - 1)))
         {
-            for(int i = 0; i < (int)tab->capacity; i++)
-            {
-                if(tab->entries[i].key != NULL)
-                {
-                    _table_entry_t* ent = find_slot(entries, capacity, tab->entries[i].key);
-
-                    // if the key is the same, (i.e. not NULL) the replace the data. There
-                    // can be no duplicate entries. No need to check it.
-                    ent->key = tab->entries[i].key;
-                    ent->size = tab->entries[i].size;
-                    ent->data = tab->entries[i].data;
-                }
-            }
-            // free the old table
-            free(tab->entries);
+            tab->slabs = (char **) REALLOC(tab->slabs, (tab->slab_count + 1) * sizeof(char *));
+            tab->slabs[tab->slab_count] = (char *) MALLOC(tab->value_size * ((size_t)FIRST_SLAB << tab->slab_count));
+            tab->slab_count++;
+            tab->slab_used = 0;
         }
+        value = &tab->slabs[tab->slab_count - 1][tab->slab_used * tab->value_size];
+        tab->slab_used++;
+    }
+
+    return (value);
+}
+
+/*
+ * Store the data of an entry. A table without a value size has a block of
+ * memory for each value.
+ */
+static void store_value(hashtable_t * tab, _table_entry_t * entry, void* data, size_t size)
+{
+    if(tab->value_size != 0)
+    {
+        size_t len = _min(size, tab->value_size);
+
+        memcpy(entry->data, data, len);
+        memset((char *)entry->data + len, 0, tab->value_size - len);
+        entry->size = tab->value_size;
+    }
+    else
+    {
+        if(entry->data != NULL)
+            FREE(entry->data);
+        entry->data = MALLOC(size);
+        memcpy(entry->data, data, size);
+        entry->size = size;
+    }
+}
 
-        tab->entries = entries;
-        tab->capacity = capacity;
+/*
+ * Free the data of an entry.
+ */
+static void free_value(hashtable_t * tab, _table_entry_t * entry)
+{
+    if(tab->value_size != 0)
+    {
+        *(void **)entry->data = tab->free_values;
+        tab->free_values = entry->data;
     }
+    else if(entry->data != NULL)
+        FREE(entry->data);
 }
 
 /**
@@ -110,16 +335,34 @@ static void grow_table(hashtable_t * tab)
  * @return hashtable_t* -- pointer to the allocated memory.
  */
 hashtable_t* create_hash_table(void)
+{
+    return (create_hash_table_sized(0));
+}
+
+/**
+ * @brief Create a hash table where all of the values have the size given.
+ * The values are kept in the table, instead of in a block of memory each, so
+ * inserts do not allocate them and find_hash_ref() can give a pointer to a
+ * value that the caller can change in place. Data that is smaller than the
+ * size is padded with zeros and data that is larger is cut off. A size of 0
+ * is the same as create_hash_table().
+ *
+ * @param size -- The size of the values.
+ * @return hashtable_t* -- pointer to the allocated memory.
+ */
+hashtable_t* create_hash_table_sized(size_t size)
 {
     hashtable_t* tab;
 
-    tab = malloc(sizeof(hashtable_t));
+    tab = (hashtable_t *) CALLOC(1, sizeof(hashtable_t));
 
-    tab->capacity = 0x01 << 3;
-    tab->entries = (_table_entry_t *) CALLOC(tab->capacity, sizeof(_table_entry_t));
+    // a free value holds the link of the free list, and is aligned for any type
+    if(size != 0)
+        tab->value_size = (size < sizeof(void *)) ? sizeof(void *) : (size + 7) & ~(size_t)7;
+
+    alloc_slots(tab, GROUP_SIZE);
     return (tab);
 }
-
 /**
  * @brief Destroy the hash table and free all memory associated with it.
  *
@@ -133,13 +376,19 @@ void destroy_hash_table(hashtable_t * tab)
         {
             for(int i = 0; i < (int)tab->capacity; i++)
             {
-                if(tab->entries[i].data != NULL)
+                if(tab->value_size == 0 && tab->entries[i].data != NULL)
                     FREE(tab->entries[i].data);
                 if(tab->entries[i].key != NULL)
                     FREE((void *)tab->entries[i].key);
             }
             FREE(tab->entries);
         }
+        if(tab->ctrl != NULL)
+            FREE(tab->ctrl);
+        for(size_t i = 0; i < tab->slab_count; i++)
+            FREE(tab->slabs[i]);
+        if(tab->slabs != NULL)
+            FREE(tab->slabs);
         FREE(tab);
     }
 }
@@ -155,18 +404,32 @@ void destroy_hash_table(hashtable_t * tab)
  * @return int -- Indicate whether the data was sored or not.
  */
 hash_retv_t insert_hash(hashtable_t * tab, const char* key, void* data, size_t size)
+{
+    return (insert_hash_h(tab, key, hash_key(key), data, size));
+}
+
+/**
+ * @brief Same as insert_hash(), with the hash of the key given by the caller,
+ * such as from get_intern_hash(). It must be what hash_key() would return.
+ */
+hash_retv_t insert_hash_h(hashtable_t * tab, const char* key, uint32_t hash, void* data, size_t size)
 {
     grow_table(tab);
 
-    _table_entry_t* entry = find_slot(tab->entries, tab->capacity, key);
-    int retv = (entry->key == NULL) ? HASH_NO_ERROR : HASH_EXIST;
+    int retv = (find_slot(tab, key, hash) < 0) ? HASH_NO_ERROR : HASH_EXIST;
 
     if(retv == HASH_NO_ERROR)
     {
+        size_t index = find_free(tab->ctrl, tab->capacity, hash);
+        _table_entry_t* entry = &tab->entries[index];
+
+        if(tab->ctrl[index] == CTRL_DELETED)
+            tab->deleted--;
+        tab->ctrl[index] = HASH_TAG(hash);
         entry->key = STRDUP(key);
-        entry->data = MALLOC(size);
-        memcpy(entry->data, data, size);
-        entry->size = size;
+        entry->hash = hash;
+        entry->data = (tab->value_size != 0) ? alloc_value(tab) : NULL;
+        store_value(tab, entry, data, size);
         tab->count++;
     }
 
@@ -174,20 +437,65 @@ hash_retv_t insert_hash(hashtable_t * tab, const char* key, void* data, size_t s
 }
 
 /**
- * @brief Replace the data that is stored in the hash table.
+ * @brief Remove an entry from the hash table and free the key and the data
+ * that was stored with it. The table may shrink when it is done.
+ *
+ * @param tab -- The table to remove the entry from.
+ * @param key -- The key of the entry.
+ * @return hash_retv_t -- HASH_NOT_FOUND if the key is not in the table.
+ */
+hash_retv_t remove_hash(hashtable_t * tab, const char* key)
+{
+    return (remove_hash_h(tab, key, hash_key(key)));
+}
+
+/**
+ * @brief Same as remove_hash(), with the hash of the key given by the caller.
+ */
+hash_retv_t remove_hash_h(hashtable_t * tab, const char* key, uint32_t hash)
+{
+    ssize_t index = find_slot(tab, key, hash);
+    int retv = HASH_NO_ERROR;
+
+    if(index >= 0)
+    {
+        _table_entry_t* entry = &tab->entries[index];
+        int8_t* group = &tab->ctrl[index & ~(size_t)(GROUP_SIZE - 1)];
+
+        free_value(tab, entry);
+        FREE((void *)entry->key);
+        memset(entry, 0, sizeof(_table_entry_t));
+
+        // see the top of the file
+        if(match_tag(group, CTRL_EMPTY) != 0)
+            tab->ctrl[index] = CTRL_EMPTY;
+        else
+        {
+            tab->ctrl[index] = CTRL_DELETED;
+            tab->deleted++;
+        }
+        tab->count--;
+
+        shrink_table(tab);
+    }
+    else
+        retv = HASH_NOT_FOUND;
+
+    return (retv);
+}
+
+/**
+ * @brief Replace the data that is stored in the hash table. In a table with
+ * a value size, the value is changed in place.
  *
  */
 hash_retv_t replace_hash_data(hashtable_t * tab, const char* key, void* data, size_t size) {
 
-    _table_entry_t* entry = find_slot(tab->entries, tab->capacity, key);
+    ssize_t index = find_slot(tab, key, hash_key(key));
     int retv = HASH_NO_ERROR;
 
-    if(entry->key != NULL) {
-        if(entry->data != NULL)
-            FREE(entry->data);
-        entry->data = MALLOC(size);
-        memcpy(entry->data, data, size);
-        entry->size = size;
+    if(index >= 0) {
+        store_value(tab, &tab->entries[index], data, size);
     }
     else
         retv = HASH_NOT_FOUND;
@@ -209,11 +517,20 @@ hash_retv_t replace_hash_data(hashtable_t * tab, const char* key, void* data, si
  */
 hash_retv_t find_hash(hashtable_t * tab, const char* key, void* data, size_t size)
 {
-    _table_entry_t* entry = find_slot(tab->entries, tab->capacity, key);
+    return (find_hash_h(tab, key, hash_key(key), data, size));
+}
+
+/**
+ * @brief Same as find_hash(), with the hash of the key given by the caller.
+ */
+hash_retv_t find_hash_h(hashtable_t * tab, const char* key, uint32_t hash, void* data, size_t size)
+{
+    ssize_t index = find_slot(tab, key, hash);
     int retv = HASH_NO_ERROR;
 
-    if(entry->key != NULL)
+    if(index >= 0)
     {
+        _table_entry_t* entry = &tab->entries[index];
         if(entry->data != NULL)
         {
             memcpy(data, entry->data, _min(size, entry->size));
@@ -226,28 +543,94 @@ hash_retv_t find_hash(hashtable_t * tab, const char* key, void* data, size_t siz
 }
 
 /**
- * @brief Iterate all of the keys in the hash table. Used for various
- * dump utilities. Make reset != 0 to reset to the beginning of the table.
- * This only returns valid keys and not empty slots.
+ * @brief Find the hash table entry and return a pointer to its data, or NULL
+ * if the key is not in the table. In a table with a value size, the pointer
+ * is good until the entry is removed and the value can be changed through it.
+ * Otherwise, replace_hash_data() gives the entry new memory.
  *
- * @param tab -- The specific table to dump.
- * @param reset -- Set to !0 to reset the index to the beginning of the table.
- * @return const char* -- The key that is stored at the hash location.
+ * @param tab -- The table to search.
+ * @param key -- The string to derive the hash from.
+ * @return void* -- The data of the entry.
  */
-const char* iterate_hash_table(hashtable_t * tab, int reset)
+void* find_hash_ref(hashtable_t * tab, const char* key)
+{
+    return (find_hash_ref_h(tab, key, hash_key(key)));
+}
+
+/**
+ * @brief Same as find_hash_ref(), with the hash of the key given by the caller.
+ */
+void* find_hash_ref_h(hashtable_t * tab, const char* key, uint32_t hash)
+{
+    ssize_t index = find_slot(tab, key, hash);
+
+    return ((index >= 0) ? tab->entries[index].data : NULL);
+}
+
+/**
+ * @brief Start a walk of the entries of the table. The iterator holds where
+ * the walk is, so walks can be nested or done by several threads at once.
+ * The table must not be changed while it is walked.
+ *
+ * @param iter -- The iterator, which the caller owns.
+ * @param tab -- The table to walk.
+ */
+void init_hash_iter(hash_iter_t* iter, hashtable_t * tab)
 {
-    static int ht_index = -1;
+    iter->tab = tab;
+    iter->index = 0;
+}
 
-    if(reset)
-        ht_index = -1;
+/**
+ * @brief Return the key of the next entry of the walk, or NULL when there
+ * are no more.
+ *
+ * @param iter -- The iterator given to init_hash_iter().
+ * @return const char* -- The key that is stored at the hash location.
+ */
+const char* next_hash_iter(hash_iter_t* iter)
+{
+    hashtable_t* tab = iter->tab;
 
-    for(ht_index++; ht_index < (int)tab->capacity; ht_index++)
+    for(; iter->index < tab->capacity; iter->index++)
     {
-        if(tab->entries[ht_index].key != NULL)
+        if(tab->ctrl[iter->index] >= 0)
         {
-            return (tab->entries[ht_index].key);
+            return (tab->entries[iter->index++].key);
         }
     }
 
     return (NULL);
 }
+
+/**
+ * @brief Return a pointer to the data of the entry that next_hash_iter()
+ * returned last. It is the same pointer that find_hash_ref() gives.
+ *
+ * @param iter -- The iterator given to init_hash_iter().
+ * @return void* -- The data of the entry.
+ */
+void* get_hash_iter_data(hash_iter_t* iter)
+{
+    return (iter->tab->entries[iter->index - 1].data);
+}
+
+/**
+ * @brief Iterate all of the keys in the hash table. Used for various
+ * dump utilities. Make reset != 0 to reset to the beginning of the table.
+ * This only returns valid keys and not empty slots. There is only one of
+ * these walks at a time in the program, use a hash_iter_t for anything else.
+ *
+ * @param tab -- The specific table to dump.
+ * @param reset -- Set to !0 to reset the index to the beginning of the table.
+ * @return const char* -- The key that is stored at the hash location.
+ */
+const char* iterate_hash_table(hashtable_t * tab, int reset)
+{
+    static hash_iter_t iter;
+
+    if(reset || iter.tab != tab)
+        init_hash_iter(&iter, tab);
+
+    return (next_hash_iter(&iter));
+}
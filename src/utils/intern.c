@@ -0,0 +1,206 @@
+/*
+    String interning
+
+    The interned strings are kept in shards, chosen by the hash of the string,
+    so threads that are scanning at the same time seldom wait on each other.
+    Each shard has its own lock, its own table of ids and its own storage for
+    the text. The records for the ids are shared by all shards and are kept in
+    chunks that never move, so looking up an id never takes a lock.
+
+    The hash is hash_key_mem() from the hash table, so it can be given to
+    the hash table instead of working it out again, see find_hash_h().
+*/
+#include "common.h"
+#include <pthread.h>
+
+#include "intern.h"
+
+#define NUM_SHARDS          (16)
+#define ID_CHUNK            (0x01 << 12)
+#define MAX_ID_CHUNKS       (0x01 << 12)
+#define TEXT_BLOCK          (0x01 << 16)
+#define SHARD_MAX_LOAD      (0.5)
+
+typedef struct {
+    const char* str;
+    uint32_t len;
+    uint32_t hash;
+} intern_entry_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    uint32_t* ids;      // open addressing table of ids, 0 is empty
+    size_t count;
+    size_t capacity;
+    char* text;         // the block that text is being added to
+    size_t text_used;
+    ptr_list_t* blocks; // all of the text blocks, for freeing them
+} intern_shard_t;
+
+static intern_shard_t shards[NUM_SHARDS];
+static intern_entry_t* id_chunks[MAX_ID_CHUNKS];
+static uint32_t next_id = 1;
+static pthread_mutex_t chunk_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline intern_entry_t* get_entry(uint32_t id) {
+
+    return &id_chunks[id / ID_CHUNK][id % ID_CHUNK];
+}
+
+// Called by atexit()
+static void destroy_intern() {
+
+    for(int i = 0; i < NUM_SHARDS; i++) {
+        intern_shard_t* shard = &shards[i];
+        ptr_list_iter_t iter;
+        init_ptr_list_iter(&iter, shard->blocks);
+        for(char* blk = next_ptr_list_iter(&iter); blk != NULL; blk = next_ptr_list_iter(&iter))
+            FREE(blk);
+        destroy_ptr_list(shard->blocks);
+        FREE(shard->ids);
+    }
+
+    for(int i = 0; i < MAX_ID_CHUNKS && id_chunks[i] != NULL; i++)
+        FREE(id_chunks[i]);
+}
+
+void init_intern() {
+
+    for(int i = 0; i < NUM_SHARDS; i++) {
+        intern_shard_t* shard = &shards[i];
+        pthread_mutex_init(&shard->lock, NULL);
+        shard->capacity = 0x01 << 8;
+        shard->ids = CALLOC(shard->capacity, sizeof(uint32_t));
+        shard->blocks = create_ptr_list();
+    }
+    atexit(destroy_intern);
+}
+
+// Keep a copy of the string with a NUL after it.
+static const char* save_text(intern_shard_t* shard, const char* str, size_t len) {
+
+    char* ptr;
+
+    if(len + 1 > TEXT_BLOCK / 4) {
+        // a long string gets a block of its own
+        ptr = MALLOC(len + 1);
+        append_ptr_list(shard->blocks, ptr);
+    }
+    else {
+        if(shard->text == NULL || shard->text_used + len + 1 > TEXT_BLOCK) {
+            shard->text = MALLOC(TEXT_BLOCK);
+            shard->text_used = 0;
+            append_ptr_list(shard->blocks, shard->text);
+        }
+        ptr = &shard->text[shard->text_used];
+        shard->text_used += len + 1;
+    }
+
+    memcpy(ptr, str, len);
+    ptr[len] = '\0';
+    return ptr;
+}
+
+static uint32_t new_id() {
+
+    uint32_t id = __atomic_fetch_add(&next_id, 1, __ATOMIC_RELAXED);
+
+    if(id / ID_CHUNK >= MAX_ID_CHUNKS)
+        fatal_error("too many interned strings: %u", id);
+
+    if(__atomic_load_n(&id_chunks[id / ID_CHUNK], __ATOMIC_ACQUIRE) == NULL) {
+        pthread_mutex_lock(&chunk_lock);
+        if(id_chunks[id / ID_CHUNK] == NULL)
+            __atomic_store_n(&id_chunks[id / ID_CHUNK],
+                    CALLOC(ID_CHUNK, sizeof(intern_entry_t)), __ATOMIC_RELEASE);
+        pthread_mutex_unlock(&chunk_lock);
+    }
+    return id;
+}
+
+static void grow_shard(intern_shard_t* shard) {
+
+    size_t capacity = shard->capacity << 1;
+    uint32_t* ids = CALLOC(capacity, sizeof(uint32_t));
+
+    for(size_t i = 0; i < shard->capacity; i++) {
+        uint32_t id = shard->ids[i];
+        if(id != NO_INTERN_ID) {
+            size_t idx = (get_entry(id)->hash / NUM_SHARDS) & (capacity - 1);
+            while(ids[idx] != NO_INTERN_ID)
+                idx = (idx + 1) & (capacity - 1);
+            ids[idx] = id;
+        }
+    }
+
+    FREE(shard->ids);
+    shard->ids = ids;
+    shard->capacity = capacity;
+}
+
+/*
+    Return the id of the string, adding it if it has not been seen before.
+*/
+uint32_t intern_mem(const char* str, size_t len) {
+
+    uint32_t hash = hash_key_mem(str, len);
+    intern_shard_t* shard = &shards[hash % NUM_SHARDS];
+    uint32_t id;
+
+    pthread_mutex_lock(&shard->lock);
+
+    // the low bits chose the shard, so use the rest for the slot
+    size_t idx = (hash / NUM_SHARDS) & (shard->capacity - 1);
+    while((id = shard->ids[idx]) != NO_INTERN_ID) {
+        intern_entry_t* ent = get_entry(id);
+        if(ent->hash == hash && ent->len == len && !memcmp(ent->str, str, len)) {
+            pthread_mutex_unlock(&shard->lock);
+            return id;
+        }
+        idx = (idx + 1) & (shard->capacity - 1);
+    }
+
+    id = new_id();
+    intern_entry_t* ent = get_entry(id);
+    ent->str = save_text(shard, str, len);
+    ent->len = (uint32_t)len;
+    ent->hash = hash;
+    shard->ids[idx] = id;
+    shard->count++;
+
+    if(shard->count > shard->capacity * SHARD_MAX_LOAD)
+        grow_shard(shard);
+
+    pthread_mutex_unlock(&shard->lock);
+    return id;
+}
+
+uint32_t intern_str(const char* str) {
+
+    return intern_mem(str, strlen(str));
+}
+
+/*
+    These return the string, its length and its hash. The string is NUL
+    terminated and stays where it is until exit.
+*/
+const char* get_intern_str(uint32_t id) {
+
+    return (id != NO_INTERN_ID && id < get_intern_count())? get_entry(id)->str: NULL;
+}
+
+size_t get_intern_len(uint32_t id) {
+
+    return (id != NO_INTERN_ID && id < get_intern_count())? get_entry(id)->len: 0;
+}
+
+uint32_t get_intern_hash(uint32_t id) {
+
+    return (id != NO_INTERN_ID && id < get_intern_count())? get_entry(id)->hash: 0;
+}
+
+// One more than the largest id that has been given out.
+uint32_t get_intern_count() {
+
+    return __atomic_load_n(&next_id, __ATOMIC_RELAXED);
+}
@@ -3,17 +3,79 @@
     error handling easier. All memory allocation errors are fatal errors.
 */
 #include "common.h"
+#include <pthread.h>
 
-static uint64_t mem_segment;
 #define SEG_MASK 0xFFFF00000000
 #define GET_SEG(p) (((uint64_t)p)&SEG_MASK)
 
+// Each thread can allocate from its own malloc arena, so there can be more
+// than one segment that allocations come from. Segments are only ever added.
+// They are kept in an open addressed set, so finding one does not depend on
+// how many there are. A slot is written once, under the lock, and read
+// without it. The low bit is set in a segment that is in the set, so that an
+// empty slot, which is zero, is not the same as segment zero.
+#define SEGMENT_SLOTS 1024
+#define SEGMENT_KEY(s) ((s) | 0x01)
+static uint64_t mem_segments[SEGMENT_SLOTS];
+static int num_segments = 0;
+static pthread_mutex_t segment_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Nearly every allocation by a thread is from the same segment as the last.
+static __thread uint64_t last_segment = 0;
+
+static inline int segment_slot(uint64_t key) {
+
+    return (int)(((key >> 32) * 0x9E3779B97F4A7C15ULL) >> 54) & (SEGMENT_SLOTS - 1);
+}
+
+static int find_segment(uint64_t seg) {
+
+    uint64_t key = SEGMENT_KEY(seg);
+    if(key == last_segment)
+        return 1;
+
+    for(int i = segment_slot(key); ; i = (i + 1) & (SEGMENT_SLOTS - 1)) {
+        uint64_t slot = __atomic_load_n(&mem_segments[i], __ATOMIC_ACQUIRE);
+        if(slot == key) {
+            last_segment = key;
+            return 1;
+        }
+        else if(slot == 0)
+            return 0;
+    }
+}
+
+static void note_segment(void* ptr) {
+
+    uint64_t seg = GET_SEG(ptr);
+    if(find_segment(seg))
+        return;
+
+    pthread_mutex_lock(&segment_lock);
+    if(!find_segment(seg)) {
+        // keep the set at most half full, so that a search stays short
+        if(num_segments >= SEGMENT_SLOTS / 2) {
+            pthread_mutex_unlock(&segment_lock);
+            fatal_error("too many memory segments: %d\n", num_segments);
+        }
+
+        uint64_t key = SEGMENT_KEY(seg);
+        int i = segment_slot(key);
+        while(mem_segments[i] != 0)
+            i = (i + 1) & (SEGMENT_SLOTS - 1);
+        __atomic_store_n(&mem_segments[i], key, __ATOMIC_RELEASE);
+        num_segments++;
+        last_segment = key;
+    }
+    pthread_mutex_unlock(&segment_lock);
+}
+
 void init_memory() {
 
     // int stackvar;
     void* ptr = malloc(1);
-    // fprintf(stderr, "stk=%p, mal=%p, glo=%p\n", &stackvar, ptr, &mem_segment);
-    mem_segment = GET_SEG(ptr);
+    // fprintf(stderr, "stk=%p, mal=%p\n", &stackvar, ptr);
+    note_segment(ptr);
 }
 
 void *memory_calloc(size_t num, size_t size) {
@@ -22,6 +84,7 @@ void *memory_calloc(size_t num, size_t size) {
     if(ptr == NULL)
         fatal_error("cannot allocate %lu bytes\n", num*size);
 
+    note_segment(ptr);
     return ptr;
 }
 
@@ -31,6 +94,7 @@ void *memory_malloc(size_t size) {
     if(ptr == NULL)
         fatal_error("cannot allocate %lu bytes\n", size);
 
+    note_segment(ptr);
     return ptr;
 }
 
@@ -40,12 +104,13 @@ void *memory_realloc(void* ptr, size_t size) {
     if(nptr == NULL)
         fatal_error("cannot reallocate %lu bytes\n", size);
 
+    note_segment(nptr);
     return nptr;
 }
 
 void memory_free(void* ptr) {
 
-    if(mem_segment != GET_SEG(ptr))
+    if(!find_segment(GET_SEG(ptr)))
         fatal_error("Attempt to free a pointer that was not allocated: %p\n", ptr);
     else
         free(ptr);
@@ -57,5 +122,6 @@ char* memory_strdup(const char* str) {
     if(nptr == NULL)
         fatal_error("cannot strdup %lu bytes\n", strlen(str));
 
+    note_segment(nptr);
     return nptr;
 }
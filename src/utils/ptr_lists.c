@@ -127,6 +127,28 @@ void* get_ptr_list_next(ptr_list_t* list)
     return NULL;  // failed
 }
 
+/*
+ * Start a walk of the list. The iterator holds where the walk is, so unlike
+ * get_ptr_list_next(), walks of the same list can be nested or done by
+ * several threads at once.
+ */
+void init_ptr_list_iter(ptr_list_iter_t* iter, ptr_list_t* list)
+{
+    iter->list = list;
+    iter->index = 0;
+}
+
+/*
+ * Return the next item of the walk, or NULL when there are no more.
+ */
+void* next_ptr_list_iter(ptr_list_iter_t* iter)
+{
+    if(iter->list != NULL && iter->index < iter->list->nitems)
+        return iter->list->buffer[iter->index++];
+
+    return NULL;
+}
+
 /*
  * Reset the internal index to zero.
  */
@@ -0,0 +1,392 @@
+/*
+    Measure how fast the scanner turns text into tokens. Each corpus is
+    written to a temporary file, which is scanned with get_tok() by a new
+    scanner on every pass, the same way the parser reads a file. The best
+    pass is reported.
+
+    The corpora are the .g files of the scanner test, or the files given, put
+    end to end until they are the size asked for, and four made up ones that
+    lean on one part of the scanner each: identifiers, comments, strings and
+    numbers.
+
+    Use: bench_scanner [-s megabytes] [-p passes] [-o results.json] [files]
+*/
+#include <time.h>
+#include <stdarg.h>
+#include <dirent.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_RDTSC
+#endif
+
+#include "common.h"
+#include "scanner.h"
+
+typedef struct {
+    const char* name;
+    char* buf;
+    size_t len;
+    // results
+    size_t tokens;
+    double seconds;
+    double cycles;      // per byte, or negative if they cannot be counted
+} corpus_t;
+
+#define MAX_CORPORA     (8)
+#define MAX_FILES       (64)
+
+static corpus_t corpora[MAX_CORPORA];
+static int num_corpora = 0;
+static unsigned int seed = 1;
+
+static unsigned int next_rand(void) {
+
+    seed = seed * 1103515245 + 12345;
+    return seed >> 16;
+}
+
+static corpus_t* new_corpus(const char* name, size_t size) {
+
+    corpus_t* corp = &corpora[num_corpora++];
+    corp->name = name;
+    corp->buf = malloc(size + 256);
+    corp->len = 0;
+    if(corp->buf == NULL) {
+        fprintf(stderr, "cannot allocate %lu bytes\n", size);
+        exit(1);
+    }
+    return corp;
+}
+
+static void add_text(corpus_t* corp, const char* str, size_t len) {
+
+    memcpy(&corp->buf[corp->len], str, len);
+    corp->len += len;
+}
+
+static void add_str(corpus_t* corp, const char* str) {
+
+    add_text(corp, str, strlen(str));
+}
+
+static void add_fmt(corpus_t* corp, const char* fmt, ...) {
+
+    va_list args;
+    va_start(args, fmt);
+    corp->len += vsprintf(&corp->buf[corp->len], fmt, args);
+    va_end(args);
+}
+
+// Read a whole file. Returns NULL if it cannot be read.
+static char* read_whole(const char* fname, size_t* len) {
+
+    FILE* fp = fopen(fname, "rb");
+    if(fp == NULL)
+        return NULL;
+
+    fseek(fp, 0, SEEK_END);
+    *len = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    char* buf = malloc(*len + 1);
+    if(buf != NULL && fread(buf, 1, *len, fp) != *len) {
+        free(buf);
+        buf = NULL;
+    }
+    fclose(fp);
+    return buf;
+}
+
+static int is_test_file(const char* name) {
+
+    size_t len = strlen(name);
+    return len > 2 && !strcmp(&name[len - 2], ".g");
+}
+
+// The files put end to end, over and over until the size is reached.
+static void make_files(size_t size, char** files, int nfiles) {
+
+    char* names[MAX_FILES];
+    char* texts[MAX_FILES];
+    size_t lens[MAX_FILES];
+    int count = 0;
+
+    if(nfiles == 0) {
+        DIR* dir = opendir(TEST_DIR);
+        struct dirent* ent;
+        while(dir != NULL && (ent = readdir(dir)) != NULL && count < MAX_FILES) {
+            if(is_test_file(ent->d_name)) {
+                names[count] = malloc(strlen(TEST_DIR) + strlen(ent->d_name) + 2);
+                sprintf(names[count], "%s/%s", TEST_DIR, ent->d_name);
+                count++;
+            }
+        }
+        if(dir != NULL)
+            closedir(dir);
+    }
+    else {
+        for(int i = 0; i < nfiles && count < MAX_FILES; i++)
+            names[count++] = strdup(files[i]);
+    }
+
+    corpus_t* corp = new_corpus("files", size);
+    int ntexts = 0;
+    for(int i = 0; i < count; i++) {
+        texts[ntexts] = read_whole(names[i], &lens[ntexts]);
+        if(texts[ntexts] != NULL && lens[ntexts] > 0 && lens[ntexts] < size)
+            ntexts++;
+        else if(texts[ntexts] == NULL)
+            fprintf(stderr, "cannot read %s\n", names[i]);
+        free(names[i]);
+    }
+
+    if(ntexts == 0) {
+        fprintf(stderr, "no input files for the files corpus\n");
+        num_corpora--;
+        free(corp->buf);
+        return;
+    }
+
+    for(int i = 0; corp->len + lens[i] <= size; i = (i + 1) % ntexts)
+        add_text(corp, texts[i], lens[i]);
+
+    for(int i = 0; i < ntexts; i++)
+        free(texts[i]);
+}
+
+static const char* keywords[] = {
+    "if", "else", "while", "return", "int", "float", "string", "class",
+    "public", "private", "for", "in", "and", "or", "not", "true", "false",
+};
+#define NUM_KEYWORDS    (sizeof(keywords)/sizeof(keywords[0]))
+
+static void add_name(corpus_t* corp) {
+
+    static const char first[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_";
+    static const char rest[] = "abcdefghijklmnopqrstuvwxyz_0123456789";
+    int len = 2 + next_rand() % 14;
+
+    corp->buf[corp->len++] = first[next_rand() % (sizeof(first) - 1)];
+    for(int i = 1; i < len; i++)
+        corp->buf[corp->len++] = rest[next_rand() % (sizeof(rest) - 1)];
+}
+
+// Statements made of names, keywords and operators.
+static void make_idents(size_t size) {
+
+    static const char* opers[] = {" = ", " + ", " == ", ".", " * ", ", ", " <= ", "->"};
+    corpus_t* corp = new_corpus("idents", size);
+
+    while(corp->len + 200 < size) {
+        add_str(corp, "    ");
+        int words = 2 + next_rand() % 6;
+        for(int i = 0; i < words; i++) {
+            if(next_rand() % 4 == 0)
+                add_str(corp, keywords[next_rand() % NUM_KEYWORDS]);
+            else
+                add_name(corp);
+            add_str(corp, (i + 1 < words)? opers[next_rand() % 8]: "\n");
+        }
+    }
+}
+
+// Mostly comments with the odd line of code.
+static void make_comments(size_t size) {
+
+    static const char* filler[] = {
+        "/*\n    This demonstrates the approximate code to find and print the\n"
+        "    factorals for a number.\n*/\n",
+        "// The constructor does not need to be declared if there are\n",
+        "        \t\t  \n\n",
+        "/**\n * When this is entered, we are parsing a function declaration and the\n"
+        " * name has been read. The opening required '(' has been read and\n"
+        " * discarded. This func reads a list of the parameter types.\n **/\n",
+        "    int number // the number to factor\n",
+    };
+    corpus_t* corp = new_corpus("comments", size);
+
+    while(corp->len + 300 < size)
+        add_str(corp, filler[next_rand() % (sizeof(filler)/sizeof(filler[0]))]);
+}
+
+// Quoted strings, some of them with escapes.
+static void make_strings(size_t size) {
+
+    static const char* parts[] = {
+        "the quick brown fox ", "jumps over ", "the lazy dog", "\\n", "\\t",
+        "\\x41", "\\\"", "<html><body>", "</body></html>", "{0} of {1}",
+    };
+    corpus_t* corp = new_corpus("strings", size);
+
+    while(corp->len + 400 < size) {
+        add_str(corp, "    print(");
+        add_str(corp, (next_rand() % 4 == 0)? "'": "\"");
+        char quote = corp->buf[corp->len - 1];
+        int count = 1 + next_rand() % 12;
+        for(int i = 0; i < count; i++) {
+            int idx = next_rand() % (sizeof(parts)/sizeof(parts[0]));
+            // escapes only mean something in a double quoted string
+            if(quote == '\'' && parts[idx][0] == '\\')
+                continue;
+            add_str(corp, parts[idx]);
+        }
+        add_text(corp, &quote, 1);
+        add_str(corp, ")\n");
+    }
+}
+
+// Lists of numbers of every kind.
+static void make_numbers(size_t size) {
+
+    corpus_t* corp = new_corpus("numbers", size);
+
+    while(corp->len + 200 < size) {
+        add_str(corp, "    [");
+        int count = 4 + next_rand() % 8;
+        for(int i = 0; i < count; i++) {
+            switch(next_rand() % 5) {
+                case 0: add_fmt(corp, "%u", next_rand()); break;
+                case 1: add_fmt(corp, "0x%X", next_rand() * next_rand()); break;
+                case 2: add_fmt(corp, "0%o", next_rand()); break;
+                case 3: add_fmt(corp, "%u.%u", next_rand() % 1000, next_rand()); break;
+                case 4: add_fmt(corp, "%u.%ue-%u", next_rand() % 10, next_rand(), next_rand() % 300); break;
+            }
+            add_str(corp, (i + 1 < count)? ", ": "]\n");
+        }
+    }
+}
+
+static double now(void) {
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void run_corpus(corpus_t* corp, int passes) {
+
+    char fname[] = "/tmp/bench_scanner_XXXXXX";
+    int fd = mkstemp(fname);
+    if(fd < 0 || write(fd, corp->buf, corp->len) != (ssize_t)corp->len) {
+        fprintf(stderr, "cannot write a temporary file: %s\n", strerror(errno));
+        exit(1);
+    }
+    close(fd);
+
+    corp->seconds = 1e30;
+    corp->cycles = -1.0;
+    for(int p = 0; p < passes; p++) {
+        size_t tokens = 0;
+        scanner_t* scn = create_scanner();
+        scanner_t* prev = bind_scanner(scn);
+
+        double start = now();
+#ifdef HAVE_RDTSC
+        uint64_t tsc = __rdtsc();
+#endif
+        open_scanner_file(fname);
+        while(get_tok() != END_OF_INPUT)
+            tokens++;
+#ifdef HAVE_RDTSC
+        tsc = __rdtsc() - tsc;
+#endif
+        double elapsed = now() - start;
+
+        bind_scanner(prev);
+        destroy_scanner(scn);
+
+        if(elapsed < corp->seconds) {
+            corp->seconds = elapsed;
+#ifdef HAVE_RDTSC
+            corp->cycles = (double)tsc / corp->len;
+#endif
+        }
+        corp->tokens = tokens;
+    }
+    unlink(fname);
+}
+
+static void write_json(const char* fname, int passes) {
+
+    FILE* fp = fopen(fname, "w");
+    if(fp == NULL) {
+        fprintf(stderr, "cannot open %s: %s\n", fname, strerror(errno));
+        return;
+    }
+
+    fprintf(fp, "{\n  \"passes\": %d,\n  \"corpora\": [\n", passes);
+    for(int i = 0; i < num_corpora; i++) {
+        corpus_t* corp = &corpora[i];
+        fprintf(fp, "    {\"name\": \"%s\", \"bytes\": %lu, \"tokens\": %lu, "
+                    "\"seconds\": %.6f, \"mb_per_sec\": %.2f, \"tokens_per_sec\": %.0f, ",
+                    corp->name, corp->len, corp->tokens, corp->seconds,
+                    corp->len / corp->seconds / (1 << 20), corp->tokens / corp->seconds);
+        if(corp->cycles < 0)
+            fprintf(fp, "\"cycles_per_byte\": null}");
+        else
+            fprintf(fp, "\"cycles_per_byte\": %.2f}", corp->cycles);
+        fprintf(fp, "%s\n", (i + 1 < num_corpora)? ",": "");
+    }
+    fprintf(fp, "  ]\n}\n");
+    fclose(fp);
+}
+
+int main(int argc, char** argv) {
+
+    size_t mbytes = 16;
+    int passes = 5, opt;
+    const char* json = NULL;
+
+    while((opt = getopt(argc, argv, "s:p:o:")) != -1) {
+        switch(opt) {
+            case 's': mbytes = strtoul(optarg, NULL, 10); break;
+            case 'p': passes = atoi(optarg); break;
+            case 'o': json = optarg; break;
+            default:
+                fprintf(stderr, "use: bench_scanner [-s megabytes] [-p passes] [-o results.json] [files]\n");
+                return 1;
+        }
+    }
+    if(mbytes == 0 || passes <= 0) {
+        fprintf(stderr, "the size and the number of passes must be more than zero\n");
+        return 1;
+    }
+
+    size_t size = mbytes << 20;
+    init_memory();
+    init_scanner();
+
+    // some of the test files have errors in them on purpose
+    FILE* null_fp = fopen("/dev/null", "w");
+    if(null_fp != NULL)
+        set_thread_err_stream(null_fp);
+
+    make_files(size, &argv[optind], argc - optind);
+    make_idents(size);
+    make_comments(size);
+    make_strings(size);
+    make_numbers(size);
+
+    printf("%-10s %10s %10s %10s %12s %8s\n", "corpus", "bytes", "tokens", "MB/s", "tokens/s", "cyc/B");
+    for(int i = 0; i < num_corpora; i++) {
+        corpus_t* corp = &corpora[i];
+        run_corpus(corp, passes);
+        printf("%-10s %10lu %10lu %10.1f %12.0f ", corp->name, corp->len, corp->tokens,
+                    corp->len / corp->seconds / (1 << 20), corp->tokens / corp->seconds);
+        if(corp->cycles < 0)
+            printf("%8s\n", "n/a");
+        else
+            printf("%8.2f\n", corp->cycles);
+        free(corp->buf);
+    }
+
+    if(json != NULL)
+        write_json(json, passes);
+
+    if(null_fp != NULL) {
+        set_thread_err_stream(NULL);
+        fclose(null_fp);
+    }
+    return 0;
+}
@@ -0,0 +1,350 @@
+/*
+    Corpus generator
+
+    Writes a made up Glang program of any size, for scale testing the scanner,
+    the symbol table and the parser. The program is a set of modules, each of
+    which imports some of the modules before it, so the imports never make a
+    cycle. Each module has a number of classes, each with data members,
+    methods and a constructor, and the methods have bodies of statements.
+
+    The classes of a module are in inheritance chains of the depth given. The
+    first class of a chain inherits nothing and each of the others inherits
+    the one before it.
+
+    Half of the imports of a module are of the first few modules, which makes
+    them imported by many modules, as a library is. The rest are chosen from
+    all of the modules before it.
+
+    Everything comes from one xorshift generator, so the same options and seed
+    always give the same files.
+
+    Use: gen_corpus [options] output_directory
+        -s seed        seed of the generator (1)
+        -n modules     number of modules (10)
+        -c classes     classes in each module (10)
+        -m members     data members and methods in each class (8)
+        -d depth       depth of the inheritance chains (3)
+        -f imports     imports of each module (3)
+        -b statements  statements in each method body (10)
+
+    The modules are mod_0.g and up. main.g imports the ones that no other
+    module imports.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define MAX_NEST    (3)
+
+typedef struct {
+    unsigned long seed;
+    int modules;
+    int classes;
+    int members;
+    int depth;
+    int imports;
+    int statements;
+    const char* outdir;
+} options_t;
+
+static options_t opts = {1, 10, 10, 8, 3, 3, 10, NULL};
+static uint64_t state;
+
+static const char* types[] = {"int", "uint", "float"};
+static const char* scopes[] = {"public", "private", "protected"};
+static const char* arith[] = {"+", "-", "*", "/", "%"};
+static const char* compare[] = {"<", ">", "<=", ">=", "equ", "neq"};
+
+// xorshift64*
+static uint64_t next_rand(void) {
+
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 0x2545F4914F6CDD1Dull;
+}
+
+static int pick(int n) {
+
+    return (int)(next_rand() % (uint64_t)n);
+}
+
+/*
+    The members of a class are numbered. A data member has an even number and
+    a method an odd one, so a method body can name the members of its class
+    without keeping a list of them. They are all numbers, so any of them can
+    be used in an expression.
+*/
+static int is_method(int mem) {
+
+    return mem % 2 == 1;
+}
+
+static int data_member(void) {
+
+    return 2 * pick((opts.members + 1) / 2);
+}
+
+static void class_name(char* buf, size_t len, int mod, int cls) {
+
+    snprintf(buf, len, "mod%d_cls%d", mod, cls);
+}
+
+static void indent(FILE* fp, int level) {
+
+    for(int i = 0; i < level; i++)
+        fputs("    ", fp);
+}
+
+// An arithmetic expression over the locals and the numeric members.
+static void write_expr(FILE* fp, int nlocals, int terms) {
+
+    for(int i = 0; i < terms; i++) {
+        if(i > 0)
+            fprintf(fp, " %s ", arith[pick(5)]);
+        switch(pick(4)) {
+            case 0:
+                fprintf(fp, "%d", pick(1000));
+                break;
+            case 1:
+                if(nlocals > 0) {
+                    fprintf(fp, "v%d", pick(nlocals));
+                    break;
+                }
+                // fall through
+            case 2:
+                fprintf(fp, "m%d", data_member());
+                break;
+            case 3:
+                fprintf(fp, "(p0 + %d)", pick(100));
+                break;
+        }
+    }
+}
+
+static void write_cond(FILE* fp, int nlocals) {
+
+    write_expr(fp, nlocals, 1);
+    fprintf(fp, " %s ", compare[pick(6)]);
+    write_expr(fp, nlocals, 1 + pick(2));
+}
+
+static int write_stmts(FILE* fp, int mod, int cls, int count, int level, int nlocals);
+
+static int write_stmt(FILE* fp, int mod, int cls, int level, int nlocals, int* budget) {
+
+    int kind = pick((level < MAX_NEST && *budget > 2)? 7: 4);
+
+    (*budget)--;
+    indent(fp, level);
+    switch(kind) {
+        case 0:     // new local
+            fprintf(fp, "int v%d = ", nlocals);
+            write_expr(fp, nlocals, 1 + pick(4));
+            fputc('\n', fp);
+            return nlocals + 1;
+        case 1:     // assign a member
+            fprintf(fp, "m%d = ", data_member());
+            write_expr(fp, nlocals, 1 + pick(4));
+            fputc('\n', fp);
+            break;
+        case 2:     // call a method
+            if(opts.members > 1) {
+                fprintf(fp, "f%d(", 2 * pick(opts.members / 2) + 1);
+                write_expr(fp, nlocals, 1 + pick(2));
+                fprintf(fp, ")\n");
+                break;
+            }
+            // fall through
+        case 3:     // print
+            fprintf(fp, "print(\"value {0} in mod%d_cls%d\\n\"(", mod, cls);
+            write_expr(fp, nlocals, 1 + pick(2));
+            fprintf(fp, "))\n");
+            break;
+        case 4: {   // if/else
+                int sub = 1 + pick(*budget / 2 + 1);
+                *budget -= sub;
+                fprintf(fp, "if(");
+                write_cond(fp, nlocals);
+                fprintf(fp, ") {\n");
+                write_stmts(fp, mod, cls, sub, level + 1, nlocals);
+                indent(fp, level);
+                if(pick(2)) {
+                    fprintf(fp, "}\n");
+                    indent(fp, level);
+                    fprintf(fp, "else {\n");
+                    write_stmts(fp, mod, cls, 1, level + 1, nlocals);
+                    indent(fp, level);
+                }
+                fprintf(fp, "}\n");
+            }
+            break;
+        case 5: {   // while
+                int sub = 1 + pick(*budget / 2 + 1);
+                *budget -= sub;
+                fprintf(fp, "while(");
+                write_cond(fp, nlocals);
+                fprintf(fp, ") {\n");
+                write_stmts(fp, mod, cls, sub, level + 1, nlocals);
+                indent(fp, level + 1);
+                fprintf(fp, "break\n");
+                indent(fp, level);
+                fprintf(fp, "}\n");
+            }
+            break;
+        case 6: {   // for
+                int sub = 1 + pick(*budget / 2 + 1);
+                *budget -= sub;
+                fprintf(fp, "for(int i%d = 0; i%d < %d; i%d++) {\n",
+                            level, level, 1 + pick(100), level);
+                write_stmts(fp, mod, cls, sub, level + 1, nlocals);
+                indent(fp, level);
+                fprintf(fp, "}\n");
+            }
+            break;
+    }
+    return nlocals;
+}
+
+static int write_stmts(FILE* fp, int mod, int cls, int count, int level, int nlocals) {
+
+    int budget = count;
+    while(budget > 0)
+        nlocals = write_stmt(fp, mod, cls, level, nlocals, &budget);
+    return nlocals;
+}
+
+static void write_class(FILE* fp, int mod, int cls) {
+
+    char name[64], parent[64];
+
+    class_name(name, sizeof(name), mod, cls);
+    if(cls % opts.depth == 0)
+        parent[0] = '\0';
+    else
+        class_name(parent, sizeof(parent), mod, cls - 1);
+
+    fprintf(fp, "class %s(%s) {\n\n", name, parent);
+    for(int mem = 0; mem < opts.members; mem++) {
+        if(is_method(mem))
+            fprintf(fp, "    %s %s f%d(int)\n", scopes[pick(3)], types[pick(3)], mem);
+        else
+            fprintf(fp, "    %s %s m%d\n", scopes[pick(3)], types[pick(3)], mem);
+    }
+    fprintf(fp, "    constructor(int)\n}\n\n");
+
+    fprintf(fp, "%s.constructor(p0) {\n\n", name);
+    for(int mem = 0; mem < opts.members; mem += 2)
+        fprintf(fp, "    m%d = p0 + %d\n", mem, pick(1000));
+    fprintf(fp, "}\n\n");
+
+    for(int mem = 1; mem < opts.members; mem += 2) {
+        fprintf(fp, "%s.f%d(p0) {\n\n", name, mem);
+        write_stmts(fp, mod, cls, opts.statements, 1, 0);
+        indent(fp, 1);
+        fprintf(fp, "return p0\n}\n\n");
+    }
+}
+
+static FILE* open_output(const char* name) {
+
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", opts.outdir, name);
+    FILE* fp = fopen(path, "w");
+    if(fp == NULL) {
+        fprintf(stderr, "gen_corpus: cannot open %s\n", path);
+        exit(1);
+    }
+    return fp;
+}
+
+static void use(void) {
+
+    fprintf(stderr, "use: gen_corpus [-s seed] [-n modules] [-c classes] [-m members]\n"
+                    "                [-d depth] [-f imports] [-b statements] output_directory\n");
+    exit(1);
+}
+
+static int get_num(const char* str, int min) {
+
+    char* end;
+    long val = strtol(str, &end, 0);
+    if(*end != '\0' || val < min) {
+        fprintf(stderr, "gen_corpus: bad number: %s\n", str);
+        use();
+    }
+    return (int)val;
+}
+
+int main(int argc, char** argv) {
+
+    int opt;
+    char fname[64];
+
+    while((opt = getopt(argc, argv, "s:n:c:m:d:f:b:")) != -1) {
+        switch(opt) {
+            case 's': opts.seed = strtoul(optarg, NULL, 0); break;
+            case 'n': opts.modules = get_num(optarg, 1); break;
+            case 'c': opts.classes = get_num(optarg, 1); break;
+            case 'm': opts.members = get_num(optarg, 1); break;
+            case 'd': opts.depth = get_num(optarg, 1); break;
+            case 'f': opts.imports = get_num(optarg, 0); break;
+            case 'b': opts.statements = get_num(optarg, 1); break;
+            default: use();
+        }
+    }
+    if(optind + 1 != argc)
+        use();
+    opts.outdir = argv[optind];
+    mkdir(opts.outdir, 0777);
+
+    // zero is a fixed point of xorshift
+    state = opts.seed * 0x9E3779B97F4A7C15ull + 1;
+
+    char* imported = calloc(opts.modules, 1);
+    char* uses = calloc(opts.modules, 1);
+    int hubs = 1;
+    while(hubs * hubs < opts.modules)
+        hubs++;
+
+    for(int mod = 0; mod < opts.modules; mod++) {
+        snprintf(fname, sizeof(fname), "mod_%d.g", mod);
+        FILE* fp = open_output(fname);
+
+        fprintf(fp, "/*\n    Module %d of a corpus made by gen_corpus with the seed %lu.\n*/\n",
+                    mod, opts.seed);
+
+        memset(uses, 0, opts.modules);
+        int count = (opts.imports < mod)? opts.imports: mod;
+        for(int i = 0; i < count; i++) {
+            int from = pick(2)? pick((hubs < mod)? hubs: mod): pick(mod);
+            while(uses[from])
+                from = (from + 1) % mod;
+            uses[from] = 1;
+            imported[from] = 1;
+            fprintf(fp, "import \"mod_%d\"\n", from);
+        }
+        fputc('\n', fp);
+
+        for(int cls = 0; cls < opts.classes; cls++)
+            write_class(fp, mod, cls);
+        fclose(fp);
+    }
+
+    FILE* fp = open_output("main.g");
+    fprintf(fp, "/*\n    Main module of a corpus made by gen_corpus with the seed %lu.\n*/\n",
+                opts.seed);
+    for(int mod = 0; mod < opts.modules; mod++)
+        if(!imported[mod])
+            fprintf(fp, "import \"mod_%d\"\n", mod);
+    fprintf(fp, "\nclass main {}\n\nmain.constructor() {\n\n"
+                "    mod0_cls0 obj = mod0_cls0(0)\n}\n");
+    fclose(fp);
+
+    free(imported);
+    free(uses);
+    return 0;
+}
@@ -0,0 +1,336 @@
+/*
+    Test of the hash table and the iterators of tables and pointer lists.
+    Prints a line for each part and exits with the number of parts that
+    failed.
+*/
+#include "common.h"
+
+BEGIN_CONFIG
+END_CONFIG
+
+#define NUM_KEYS    (5000)
+
+static int failed = 0;
+
+static int check(const char* name, int bad) {
+
+    printf("%-24s %s\n", name, (bad == 0)? "ok": "FAILED");
+    if(bad != 0)
+        failed++;
+    return bad;
+}
+
+static const char* make_key(char* buf, const char* prefix, int n) {
+
+    sprintf(buf, "%s_%d", prefix, n);
+    return buf;
+}
+
+static void test_insert() {
+
+    hashtable_t* tab = create_hash_table();
+    char key[32];
+    int bad = 0;
+
+    for(int i = 0; i < NUM_KEYS; i++)
+        if(insert_hash(tab, make_key(key, "key", i), &i, sizeof(i)) != HASH_NO_ERROR)
+            bad++;
+
+    for(int i = 0; i < NUM_KEYS; i++) {
+        int val = -1;
+        make_key(key, "key", i);
+        if(find_hash(tab, key, &val, sizeof(val)) != HASH_NO_ERROR || val != i)
+            bad++;
+        if(find_hash_h(tab, key, hash_key(key), &val, sizeof(val)) != HASH_NO_ERROR || val != i)
+            bad++;
+        if(insert_hash(tab, key, &val, sizeof(val)) != HASH_EXIST)
+            bad++;
+    }
+
+    if(tab->count != NUM_KEYS || find_hash(tab, "none", key, 4) != HASH_NOT_FOUND)
+        bad++;
+
+    for(int i = 0; i < NUM_KEYS; i += 3) {
+        int val = i * 10;
+        if(replace_hash_data(tab, make_key(key, "key", i), &val, sizeof(val)) != HASH_NO_ERROR)
+            bad++;
+    }
+    for(int i = 0; i < NUM_KEYS; i++) {
+        int val = -1;
+        find_hash(tab, make_key(key, "key", i), &val, sizeof(val));
+        if(val != ((i % 3 == 0)? i * 10: i))
+            bad++;
+    }
+    if(replace_hash_data(tab, "none", key, 4) != HASH_NOT_FOUND)
+        bad++;
+
+    // every entry keeps the hash of its key
+    for(size_t i = 0; i < tab->capacity; i++)
+        if(tab->entries[i].key != NULL && tab->entries[i].hash != hash_key(tab->entries[i].key))
+            bad++;
+
+    check("insert, find, replace", bad);
+    destroy_hash_table(tab);
+}
+
+// The table is a power of 2 in size and is never more than 7/8 full, and
+// every key is still found after it has grown.
+static void test_grow() {
+
+    hashtable_t* tab = create_hash_table();
+    char key[32];
+    int bad = 0;
+
+    for(int i = 0; i < NUM_KEYS; i++) {
+        insert_hash(tab, make_key(key, "key", i), &i, sizeof(i));
+        if((tab->capacity & (tab->capacity - 1)) != 0 || tab->count > tab->capacity * 0.875)
+            bad++;
+    }
+
+    for(int i = 0; i < NUM_KEYS; i++) {
+        int val = -1;
+        if(find_hash(tab, make_key(key, "key", i), &val, sizeof(val)) != HASH_NO_ERROR || val != i)
+            bad++;
+        if(find_hash(tab, make_key(key, "none", i), &val, sizeof(val)) != HASH_NOT_FOUND)
+            bad++;
+    }
+
+    // the empty string is a key like any other
+    if(insert_hash(tab, "", key, 1) != HASH_NO_ERROR || find_hash(tab, "", key, 1) != HASH_NO_ERROR)
+        bad++;
+
+    check("grow", bad);
+    destroy_hash_table(tab);
+}
+
+// Removed entries leave deleted slots that later inserts have to go past or
+// use again.
+static void test_reinsert() {
+
+    hashtable_t* tab = create_hash_table();
+    char key[32];
+    int bad = 0;
+
+    for(int i = 0; i < NUM_KEYS; i++)
+        insert_hash(tab, make_key(key, "key", i), &i, sizeof(i));
+    for(int i = 1; i < NUM_KEYS; i += 2)
+        if(remove_hash(tab, make_key(key, "key", i)) != HASH_NO_ERROR)
+            bad++;
+    if(remove_hash(tab, make_key(key, "key", 1)) != HASH_NOT_FOUND)
+        bad++;
+
+    for(int i = 1; i < NUM_KEYS; i += 2) {
+        int val = -i;
+        if(find_hash(tab, make_key(key, "key", i), &val, sizeof(val)) != HASH_NOT_FOUND)
+            bad++;
+        if(insert_hash(tab, key, &val, sizeof(val)) != HASH_NO_ERROR)
+            bad++;
+    }
+
+    for(int i = 0; i < NUM_KEYS; i++) {
+        int val = 0;
+        if(find_hash(tab, make_key(key, "key", i), &val, sizeof(val)) != HASH_NO_ERROR ||
+                    val != ((i & 1)? -i: i))
+            bad++;
+    }
+    if(tab->count != NUM_KEYS)
+        bad++;
+
+    // the same few keys over and over must not make the table grow
+    size_t capacity = tab->capacity;
+    for(int n = 0; n < 20; n++) {
+        for(int i = 0; i < NUM_KEYS; i += 2)
+            remove_hash(tab, make_key(key, "key", i));
+        for(int i = 0; i < NUM_KEYS; i += 2)
+            insert_hash(tab, make_key(key, "key", i), &n, sizeof(n));
+    }
+    if(tab->capacity != capacity || tab->count != NUM_KEYS)
+        bad++;
+
+    check("remove and reinsert", bad);
+    destroy_hash_table(tab);
+}
+
+// The table halves when removing an entry leaves it less than a fifth full.
+static void test_shrink() {
+
+    hashtable_t* tab = create_hash_table();
+    char key[32];
+    int bad = 0, shrunk = 0;
+
+    for(int i = 0; i < NUM_KEYS; i++)
+        insert_hash(tab, make_key(key, "key", i), &i, sizeof(i));
+
+    for(int i = 0; i < NUM_KEYS; i++) {
+        size_t capacity = tab->capacity;
+        remove_hash(tab, make_key(key, "key", i));
+        if(tab->capacity != capacity) {
+            shrunk++;
+            if(tab->capacity != capacity / 2 || tab->count >= capacity * 0.2 ||
+                        tab->count + 1 < capacity * 0.2)
+                bad++;
+        }
+        else if(capacity > 16 && tab->count < capacity * 0.2)
+            bad++;
+
+        // the keys that are left are still found
+        if((i % 500) == 0)
+            for(int j = i + 1; j < NUM_KEYS; j++) {
+                int val = -1;
+                if(find_hash(tab, make_key(key, "key", j), &val, sizeof(val)) != HASH_NO_ERROR || val != j)
+                    bad++;
+            }
+    }
+
+    if(shrunk == 0 || tab->count != 0 || tab->capacity != 16)
+        bad++;
+
+    check("shrink", bad);
+    destroy_hash_table(tab);
+}
+
+typedef struct {
+    int num;
+    double half;
+    char name[20];
+} value_t;
+
+// In a table with a value size the values do not move, so a reference stays
+// good while other entries come and go.
+static void test_sized() {
+
+    hashtable_t* tab = create_hash_table_sized(sizeof(value_t));
+    value_t** refs = MALLOC(NUM_KEYS * sizeof(value_t*));
+    char key[32];
+    int bad = 0;
+
+    for(int i = 0; i < NUM_KEYS; i++) {
+        value_t val = {i, i * 0.5, "value"};
+        insert_hash(tab, make_key(key, "key", i), &val, sizeof(val));
+        refs[i] = find_hash_ref(tab, key);
+        if(refs[i] == NULL || refs[i]->num != i || strcmp(refs[i]->name, "value"))
+            bad++;
+    }
+
+    for(int i = 0; i < NUM_KEYS; i++) {
+        if(find_hash_ref(tab, make_key(key, "key", i)) != refs[i])
+            bad++;
+        refs[i]->num = -i;
+    }
+
+    for(int i = 0; i < NUM_KEYS; i += 2)
+        remove_hash(tab, make_key(key, "key", i));
+    for(int i = 0; i < NUM_KEYS; i += 2)
+        insert_hash(tab, make_key(key, "other", i), &i, sizeof(i));
+
+    for(int i = 1; i < NUM_KEYS; i += 2) {
+        value_t val;
+        make_key(key, "key", i);
+        if(find_hash_ref_h(tab, key, hash_key(key)) != refs[i])
+            bad++;
+        if(find_hash(tab, key, &val, sizeof(val)) != HASH_NO_ERROR || val.num != -i || val.half != i * 0.5)
+            bad++;
+    }
+
+    // shorter data is padded with zeros
+    int num = 7;
+    replace_hash_data(tab, make_key(key, "key", 1), &num, sizeof(num));
+    if(refs[1]->num != 7 || refs[1]->half != 0.0)
+        bad++;
+    if(find_hash_ref(tab, "none") != NULL)
+        bad++;
+
+    check("sized table", bad);
+    FREE(refs);
+    destroy_hash_table(tab);
+}
+
+static void test_iterators() {
+
+    hashtable_t* tab = create_hash_table();
+    hash_iter_t outer, inner;
+    char key[32];
+    int bad = 0;
+
+    // an empty table has nothing to walk
+    init_hash_iter(&outer, tab);
+    if(next_hash_iter(&outer) != NULL || iterate_hash_table(tab, 1) != NULL)
+        bad++;
+
+    for(int i = 0; i < 100; i++)
+        insert_hash(tab, make_key(key, "key", i), &i, sizeof(i));
+
+    // walks can be nested, and each sees every entry once
+    int pairs = 0, seen = 0;
+    long sum = 0;
+    init_hash_iter(&outer, tab);
+    for(const char* str = next_hash_iter(&outer); str != NULL; str = next_hash_iter(&outer)) {
+        int val = *(int*)get_hash_iter_data(&outer);
+        sum += val;
+        if(strcmp(str, make_key(key, "key", val)))
+            bad++;
+        if(get_hash_iter_data(&outer) != find_hash_ref(tab, str))
+            bad++;
+
+        init_hash_iter(&inner, tab);
+        while(next_hash_iter(&inner) != NULL)
+            pairs++;
+    }
+    if(sum != 99 * 100 / 2 || pairs != 100 * 100)
+        bad++;
+
+    for(const char* str = iterate_hash_table(tab, 1); str != NULL; str = iterate_hash_table(tab, 0))
+        seen++;
+    if(seen != 100)
+        bad++;
+
+    // a table that has been emptied walks like an empty one
+    for(int i = 0; i < 100; i++)
+        remove_hash(tab, make_key(key, "key", i));
+    init_hash_iter(&outer, tab);
+    if(next_hash_iter(&outer) != NULL || iterate_hash_table(tab, 1) != NULL)
+        bad++;
+
+    check("table iterators", bad);
+    destroy_hash_table(tab);
+
+    ptr_list_t* list = create_ptr_list();
+    ptr_list_iter_t first, second;
+    bad = 0;
+
+    init_ptr_list_iter(&first, list);
+    if(next_ptr_list_iter(&first) != NULL)
+        bad++;
+
+    for(long i = 1; i <= 50; i++)
+        append_ptr_list(list, (void*)i);
+
+    long total = 0;
+    pairs = 0;
+    init_ptr_list_iter(&first, list);
+    for(void* ptr = next_ptr_list_iter(&first); ptr != NULL; ptr = next_ptr_list_iter(&first)) {
+        total += (long)ptr;
+        init_ptr_list_iter(&second, list);
+        while(next_ptr_list_iter(&second) != NULL)
+            pairs++;
+    }
+    if(total != 50 * 51 / 2 || pairs != 50 * 50)
+        bad++;
+
+    check("pointer list iterators", bad);
+    destroy_ptr_list(list);
+}
+
+int main() {
+
+    init_memory();
+
+    test_insert();
+    test_grow();
+    test_reinsert();
+    test_shrink();
+    test_sized();
+    test_iterators();
+
+    return failed;
+}
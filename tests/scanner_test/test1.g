@@ -52,6 +52,7 @@ blart blast () {} [] .,:;/ 123/345
 123.23e+12345
 -123.23e+3 +123.23e-1223488
 123.23e-1223423
+1.0e-310
 // this is a comment
 fart
 /* this is a comment too */
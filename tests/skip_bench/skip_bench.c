@@ -0,0 +1,117 @@
+/*
+    Compare the vectorized white space and comment skipping routines with the
+    plain loops they replace, over a comment heavy buffer.
+
+    Use: skip_bench [megabytes] [passes]
+*/
+#include <time.h>
+
+#include "common.h"
+#include "scanner.h"
+#include "local.h"
+
+typedef struct {
+    const char* name;
+    size_t (*blanks)(const char*, size_t, size_t);
+    size_t (*line_end)(const char*, size_t, size_t);
+    size_t (*comment_end)(const char*, size_t, size_t);
+} skipper_t;
+
+static const char* filler[] = {
+    "/*\n    This demonstrates the approximate code to find and print the\n"
+    "    factorals for a number.\n*/\n",
+    "// The constructor does not need to be declared if there are\n",
+    "        \t\t  \n\n",
+    "/**\n * When this is entered, we are parsing a function declaration and the\n"
+    " * name has been read. The opening required '(' has been read and\n"
+    " * discarded. This func reads a list of the parameter types.\n **/\n",
+    "    int number // the number to factor\n",
+};
+
+// Fill the buffer with comments, blank lines and the odd line of code.
+static char* make_buffer(size_t size) {
+
+    char* buf = malloc(size);
+    size_t len = 0;
+    unsigned int seed = 1;
+
+    if(buf == NULL)
+        return NULL;
+
+    while(len < size) {
+        seed = seed * 1103515245 + 12345;
+        const char* str = filler[(seed >> 16) % (sizeof(filler)/sizeof(filler[0]))];
+        size_t slen = strlen(str);
+        if(len + slen > size)
+            slen = size - len;
+        memcpy(&buf[len], str, slen);
+        len += slen;
+    }
+    return buf;
+}
+
+// Walk the buffer the way the scanner does between tokens. Returns the
+// number of bytes that are not white space or comment.
+static size_t walk(const skipper_t* sk, const char* buf, size_t len) {
+
+    size_t pos = 0, other = 0;
+
+    while(1) {
+        pos = sk->blanks(buf, pos, len);
+        if(pos >= len)
+            break;
+        if(buf[pos] == '/' && pos + 1 < len && buf[pos+1] == '*')
+            pos = sk->comment_end(buf, pos + 2, len);
+        else if(buf[pos] == '/' && pos + 1 < len && buf[pos+1] == '/')
+            pos = sk->line_end(buf, pos + 2, len);
+        else {
+            pos++;
+            other++;
+        }
+    }
+    return other;
+}
+
+static double now(void) {
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char** argv) {
+
+    size_t mbytes = (argc > 1)? strtoul(argv[1], NULL, 10): 64;
+    int passes = (argc > 2)? atoi(argv[2]): 5;
+    size_t len = mbytes << 20;
+
+    skipper_t skippers[] = {
+        {"scalar", skip_blanks_scalar, find_line_end_scalar, find_comment_end_scalar},
+        {"vector", skip_blanks, find_line_end, find_comment_end},
+    };
+    double rate[2];
+
+    char* buf = make_buffer(len);
+    if(buf == NULL) {
+        fprintf(stderr, "cannot allocate %lu bytes\n", len);
+        return 1;
+    }
+
+    for(int i = 0; i < 2; i++) {
+        double best = 1e30;
+        size_t other = 0;
+        for(int p = 0; p < passes; p++) {
+            double start = now();
+            other = walk(&skippers[i], buf, len);
+            double elapsed = now() - start;
+            if(elapsed < best)
+                best = elapsed;
+        }
+        rate[i] = mbytes / best;
+        printf("%-8s %8.1f MB/s  (%lu code bytes)\n", skippers[i].name, rate[i], other);
+    }
+    printf("speedup  %8.2fx\n", rate[1] / rate[0]);
+
+    free(buf);
+    return 0;
+}